@@ -0,0 +1,726 @@
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Compression.h"
+#include "Culling.h"
+#include "Feature.h"
+#include "FeatureDecoder.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Generator.h"
+#include "Lod.h"
+#include "Pipeline.h"
+#include "Reader.h"
+#include "Retained.h"
+#include "Scheduler.h"
+#include "Shapes.h"
+#include "Sharded.h"
+#include "Spatial.h"
+#include "Tessellation.h"
+#include "Testing.h"
+#include "Transform.h"
+#include "Validation.h"
+
+namespace
+{
+    const std::array<Figure::Type, 3> ALL_TYPES = { Figure::eCircle, Figure::eTriangle, Figure::eSquare };
+
+    const Figure::Factory &factory()
+    {
+        static const Figure::Factory figureFactory = []()
+        {
+            Figure::Factory res;
+            Figure::Figures::registerFigures(res);
+            return res;
+        }();
+        return figureFactory;
+    }
+
+    /*!
+         \brief Временный файл с записями, удаляется вместе с объектом
+     */
+    class TempFile
+    {
+        std::string _filename;
+
+    public:
+        TempFile(const std::vector<uint8_t> &data, const std::string &name)
+            : _filename((std::filesystem::temp_directory_path() / name).string())
+        {
+            std::unique_ptr<FILE, int(*)(FILE*)> file(::fopen(_filename.c_str(), "wb"), ::fclose);
+            if (file)
+                ::fwrite(data.data(), 1, data.size(), file.get());
+        }
+        ~TempFile() { std::remove(_filename.c_str()); }
+        const std::string &filename() const { return _filename; }
+    };
+
+    /*!
+         \brief Количество записей смеси всех типов примерно на size байт
+     */
+    size_t countRecordsForSize(size_t size)
+    {
+        const size_t averageRecord = sizeof(Figure::Type) + (3 + 6 + 8) * sizeof(double) / 3;
+        return std::max<size_t>(size / averageRecord, 1);
+    }
+}
+
+static void BM_FactoryCreateFigure(benchmark::State &state)
+{
+    const Figure::Type type = static_cast<Figure::Type>(state.range(0));
+    for (auto _ : state)
+    {
+        std::unique_ptr<Figure::Figure> figure(factory().createFigure(type));
+        benchmark::DoNotOptimize(figure.get());
+    }
+}
+BENCHMARK(BM_FactoryCreateFigure)->DenseRange(Figure::eCircle, Figure::eSquare);
+
+static void BM_FactoryPrototype(benchmark::State &state)
+{
+    const Figure::Type type = static_cast<Figure::Type>(state.range(0));
+    for (auto _ : state)
+        benchmark::DoNotOptimize(factory().prototype(type));
+}
+BENCHMARK(BM_FactoryPrototype)->DenseRange(Figure::eCircle, Figure::eSquare);
+
+static void BM_FeatureRead(benchmark::State &state)
+{
+    const std::array<Figure::Type, 1> types = { static_cast<Figure::Type>(state.range(0)) };
+    const size_t COUNT_RECORDS = 1 << 16;
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), types, COUNT_RECORDS);
+
+    Reader::Memory reader(data);
+    Feature feature(factory());
+    for (auto _ : state)
+    {
+        if (!feature.read(reader))
+        {
+            reader.seek(0);
+            feature.read(reader);
+        }
+        benchmark::DoNotOptimize(feature.params().data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FeatureRead)->DenseRange(Figure::eCircle, Figure::eSquare);
+
+static void BM_TypedFeatureRead(benchmark::State &state)
+{
+    const std::array<Figure::Type, 1> types = { static_cast<Figure::Type>(state.range(0)) };
+    const size_t COUNT_RECORDS = 1 << 16;
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), types, COUNT_RECORDS);
+
+    Reader::Memory reader(data);
+    const TypedFeature<Figure::Figures> feature;
+    auto onRecord = [](const auto &record) { benchmark::DoNotOptimize(record.params.data()); };
+    for (auto _ : state)
+    {
+        if (!feature.read(reader, onRecord))
+        {
+            reader.seek(0);
+            feature.read(reader, onRecord);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TypedFeatureRead)->DenseRange(Figure::eCircle, Figure::eSquare);
+
+/*!
+     \brief Накопление параметров пакета записей в арене с освобождением пакета целиком
+ */
+static void BM_FeatureReadArena(benchmark::State &state)
+{
+    const size_t COUNT_RECORDS = 1 << 16;
+    const size_t BATCH_SIZE = 4096;
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, COUNT_RECORDS);
+
+    Utils::Arena arena;
+    std::vector<Utils::Span<const double>> params;
+    params.reserve(BATCH_SIZE);
+    for (auto _ : state)
+    {
+        Reader::Memory reader(data);
+        Feature feature(factory());
+        feature.setArena(&arena);
+        while (feature.read(reader))
+        {
+            params.push_back(feature.params());
+            if (params.size() == BATCH_SIZE)
+            {
+                benchmark::DoNotOptimize(params.back().data());
+                params.clear();
+                arena.reset();
+            }
+        }
+        params.clear();
+        arena.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * COUNT_RECORDS);
+}
+BENCHMARK(BM_FeatureReadArena);
+
+template <typename FileReader>
+static void BM_ReaderThroughput(benchmark::State &state)
+{
+    const size_t size = static_cast<size_t>(state.range(0));
+    const TempFile file(Testing::makeRecords(factory(), ALL_TYPES, countRecordsForSize(size)), "prosoft_bench.dat");
+    const size_t fileSize = std::filesystem::file_size(file.filename());
+
+    for (auto _ : state)
+    {
+        FileReader reader(file.filename());
+        Feature feature(factory());
+        size_t count = 0;
+        while (feature.read(reader))
+            ++count;
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetBytesProcessed(state.iterations() * fileSize);
+}
+BENCHMARK_TEMPLATE(BM_ReaderThroughput, Reader::File)->RangeMultiplier(8)->Range(1 << 20, 64 << 20);
+BENCHMARK_TEMPLATE(BM_ReaderThroughput, Reader::BufferedFile)->RangeMultiplier(8)->Range(1 << 20, 64 << 20);
+#ifdef PROSOFT_HAS_MMAP
+BENCHMARK_TEMPLATE(BM_ReaderThroughput, Reader::MappedFile)->RangeMultiplier(8)->Range(1 << 20, 64 << 20);
+#endif
+#ifdef PROSOFT_HAS_URING
+BENCHMARK_TEMPLATE(BM_ReaderThroughput, Reader::UringFile)->RangeMultiplier(8)->Range(1 << 20, 64 << 20);
+#endif
+
+#ifdef PROSOFT_HAS_TAIL
+/*!
+     \brief Сквозной прогон по файлу, который дописывается порциями по range(1) байт во время чтения
+ */
+static void BM_TailFollow(benchmark::State &state)
+{
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, state.range(0));
+    const TempFile file({}, "prosoft_bench_tail.dat");
+    const Testing::DrawerFake drawer;
+    const Pipeline::Executor executor(factory());
+    const size_t chunk = static_cast<size_t>(state.range(1));
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::unique_ptr<FILE, int(*)(FILE*)> out(::fopen(file.filename().c_str(), "wb"), ::fclose);
+        Reader::Tail reader(file.filename(), 0, std::chrono::milliseconds(0), std::chrono::milliseconds(1));
+        state.ResumeTiming();
+
+        std::thread writer([&]()
+        {
+            for (size_t pos = 0; pos < data.size(); pos += chunk)
+            {
+                ::fwrite(data.data() + pos, 1, std::min(chunk, data.size() - pos), out.get());
+                ::fflush(out.get());
+            }
+            reader.stop();
+        });
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+        writer.join();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_TailFollow)->ArgsProduct({ { 1 << 18 }, { 4 << 10, 1 << 20 } })->UseRealTime();
+#endif
+
+static void BM_EndToEndSequential(benchmark::State &state)
+{
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, state.range(0));
+    const Testing::DrawerFake drawer;
+    const size_t BATCH_SIZE = 4096;
+
+    for (auto _ : state)
+    {
+        Reader::Memory reader(data);
+        Feature feature(factory());
+        FeatureBatch batch;
+        uint64_t id = 0;
+        while (const size_t count = batch.read(feature, reader, BATCH_SIZE, id))
+        {
+            batch.draw(drawer);
+            batch.clear();
+            id += count;
+        }
+    }
+    benchmark::DoNotOptimize(drawer.checksum());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EndToEndSequential)->Arg(1 << 20);
+
+static void BM_EndToEndPipeline(benchmark::State &state)
+{
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, state.range(0));
+    const Testing::DrawerFake drawer;
+    const Pipeline::Executor executor(factory());
+
+    for (auto _ : state)
+    {
+        Reader::Memory reader(data);
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EndToEndPipeline)->Arg(1 << 20)->UseRealTime();
+
+static void BM_EndToEndParallelDecode(benchmark::State &state)
+{
+    const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, state.range(0));
+    const Testing::DrawerFake drawer;
+    const FeatureDecoder decoder(factory());
+
+    for (auto _ : state)
+    {
+        FeatureBatch batch;
+        decoder.decode(data, batch, state.range(1));
+        batch.draw(drawer);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EndToEndParallelDecode)->ArgsProduct({ { 1 << 20 }, { 1, 2, 4, 8 } })->UseRealTime();
+
+static void BM_EndToEndGenerated(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    options.distribution = Generator::eClusters;
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    const Testing::DrawerFake drawer;
+    const Pipeline::Executor executor(factory());
+
+    for (auto _ : state)
+    {
+        Reader::Memory reader(data);
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_EndToEndGenerated)->Arg(1 << 20)->UseRealTime();
+
+/*!
+     \brief Сквозной прогон из файла в разных представлениях параметров: эффект от объема чтения
+ */
+static void BM_EndToEndEncoding(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    options.format = Format::Format::fit(static_cast<Format::Encoding>(state.range(1)), { 0, 0, options.extent, options.extent });
+    const TempFile file(Generator::Generator(options).generate(), "prosoft_bench_encoding.dat");
+    const size_t fileSize = std::filesystem::file_size(file.filename());
+    const Testing::DrawerFake drawer;
+    Pipeline::Executor executor(factory());
+
+    for (auto _ : state)
+    {
+        Reader::BufferedFile reader(file.filename());
+        Format::Format format;
+        if (!Format::detect(reader, format))
+        {
+            state.SkipWithError("Invalid header");
+            break;
+        }
+        executor.setFormat(format);
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * fileSize);
+}
+BENCHMARK(BM_EndToEndEncoding)
+    ->ArgsProduct({ { 1 << 20 }, { Format::eFloat64, Format::eFloat32, Format::eInt32, Format::eInt16 } })
+    ->UseRealTime();
+
+/*!
+     \brief Сквозной прогон из контейнера сжатых блоков: алгоритм и количество потоков распаковки
+ */
+static void BM_EndToEndCompressed(benchmark::State &state)
+{
+    const Compression::Codec codec = static_cast<Compression::Codec>(state.range(0));
+    if (!Compression::isAvailable(codec))
+    {
+        state.SkipWithError("Codec is not available");
+        return;
+    }
+
+    Generator::Options options;
+    options.countRecords = 1 << 20;
+    options.distribution = Generator::eClusters;
+    options.format = Format::Format::fit(Format::eInt16, { 0, 0, options.extent, options.extent });
+    const std::string filename = (std::filesystem::temp_directory_path() / "prosoft_bench_compressed.dat").string();
+    {
+        std::unique_ptr<FILE, int(*)(FILE*)> file(::fopen(filename.c_str(), "wb"), ::fclose);
+        Compression::Writer writer(file.get(), codec);
+        if (!file || !Generator::Generator(options).write(writer))
+        {
+            state.SkipWithError("Cannot write container");
+            return;
+        }
+    }
+    const size_t fileSize = std::filesystem::file_size(filename);
+    const Testing::DrawerFake drawer;
+    Pipeline::Executor executor(factory());
+
+    for (auto _ : state)
+    {
+        Reader::CompressedFile reader(filename, state.range(1));
+        Format::Format format;
+        Format::detect(reader, format);
+        executor.setFormat(format);
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+    }
+    std::remove(filename.c_str());
+    state.SetItemsProcessed(state.iterations() * options.countRecords);
+    state.SetBytesProcessed(state.iterations() * fileSize);
+}
+BENCHMARK(BM_EndToEndCompressed)
+    ->ArgsProduct({ { Compression::eNone, Compression::eLz4, Compression::eZstd, Compression::eDeflate }, { 1, 4 } })
+    ->UseRealTime();
+
+static void BM_ViewportCull(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    options.extent = 1000;
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    const Culling::Viewport viewport({ 250, 250, 750, 750 });
+    FeatureBatch::Selection visible;
+    for (auto _ : state)
+    {
+        viewport.select(source, visible);
+        benchmark::DoNotOptimize(visible.circles.words().data());
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_ViewportCull)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_SpatialBuild(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    Spatial::RTree tree;
+    for (auto _ : state)
+    {
+        tree.build(source, state.range(1));
+        benchmark::DoNotOptimize(tree.bounds());
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_SpatialBuild)->ArgsProduct({ { 1 << 20 }, { 1, 4 } })->UseRealTime();
+
+/*!
+     \brief Запрос по области той же доли данных, что и в BM_ViewportCull, вместе со сбором пакета.
+            Величина - доля запрашиваемой стороны в тысячных
+ */
+static void BM_SpatialQuery(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = 1 << 20;
+    options.extent = 1000;
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    Spatial::Index index;
+    index.build(std::move(source));
+    const double half = state.range(0) / 2.0;
+    FeatureBatch found;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(index.query({ 500 - half, 500 - half, 500 + half, 500 + half }, found));
+    state.SetItemsProcessed(state.iterations() * found.size());
+}
+BENCHMARK(BM_SpatialQuery)->Arg(10)->Arg(100)->Arg(500);
+
+static void BM_AffineTransform(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    const Transform::Affine m = Transform::Affine::panZoom(0.5, 5e5, 5e5, 960, 540);
+    FeatureBatch projected;
+    for (auto _ : state)
+    {
+        Transform::apply(m, source, projected);
+        benchmark::DoNotOptimize(projected.squares.points.data());
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_AffineTransform)->Arg(1 << 16)->Arg(1 << 20);
+
+/*!
+     \brief Упрощение пакета на обзорном масштабе: величина - сторона ячейки при стороне области 1e6
+ */
+static void BM_LodSimplify(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = 1 << 20;
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    const Lod::Simplifier simplifier(static_cast<double>(state.range(0)));
+    FeatureBatch batch;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        batch = source;
+        state.ResumeTiming();
+        simplifier.simplify(batch);
+    }
+    state.SetItemsProcessed(state.iterations() * source.size());
+    state.counters["figures"] = static_cast<double>(batch.size());
+}
+BENCHMARK(BM_LodSimplify)->Arg(1000)->Arg(10000);
+
+/*!
+     \brief Перерисовка после изменения нескольких фигур сцены против полной перерисовки:
+            величина - количество изменяемых фигур на кадр
+ */
+static void BM_RetainedRedraw(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = 1 << 20;
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch source;
+    FeatureDecoder(factory()).decode(data, source);
+
+    Retained::Scene scene;
+    scene.apply(source);
+    const Testing::DrawerFake drawer;
+    scene.draw(drawer);
+
+    FeatureBatch changes;
+    for (int64_t i = 0; i < state.range(0); ++i)
+    {
+        Figure::Record<Figure::Circle> circle;
+        circle.params = {{ source.circles.centerX[i], source.circles.centerY[i], source.circles.radius[i] + 1 }};
+        changes.append(circle, source.circles.ids[i]);
+    }
+    size_t countDrawn = 0;
+    for (auto _ : state)
+    {
+        scene.apply(changes);
+        countDrawn = state.range(0) ? scene.redraw(drawer) : (scene.draw(drawer), scene.size());
+    }
+    state.SetItemsProcessed(state.iterations() * countDrawn);
+    state.counters["drawn"] = static_cast<double>(countDrawn);
+}
+BENCHMARK(BM_RetainedRedraw)->Arg(0)->Arg(1)->Arg(16)->Arg(256);
+
+/*!
+     \brief Накладные расходы пула: parallelFor по range(0) коротким вызовам
+ */
+static void BM_SchedulerParallelFor(benchmark::State &state)
+{
+    const size_t count = static_cast<size_t>(state.range(0));
+    std::vector<double> values(count, 1);
+    for (auto _ : state)
+    {
+        Scheduler::parallelFor(count, [&values](size_t i) { values[i] = values[i] * 1.0001 + 1; });
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SchedulerParallelFor)->Arg(64)->Arg(1 << 16)->UseRealTime();
+
+static void BM_Validate(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = state.range(0);
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch batch;
+    FeatureDecoder(factory()).decode(data, batch);
+
+    const Validation::Validator validator;
+    FeatureBatch::Selection valid;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(validator.select(batch, valid));
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_Validate)->Arg(1 << 16)->Arg(1 << 20);
+
+/*!
+     \brief Сквозной прогон по 16 шардам, загружаемым range(0) потоками
+ */
+static void BM_ShardedRead(benchmark::State &state)
+{
+    const size_t countShards = 16;
+    std::vector<std::unique_ptr<TempFile>> shards;
+    std::vector<std::string> files;
+    size_t size = 0;
+    for (size_t i = 0; i < countShards; ++i)
+    {
+        const std::vector<uint8_t> data = Testing::makeRecords(factory(), ALL_TYPES, 1 << 16);
+        shards.emplace_back(new TempFile(data, "prosoft_bench_shard_" + std::to_string(i) + ".dat"));
+        files.push_back(shards.back()->filename());
+        size += data.size();
+    }
+    const Testing::DrawerFake drawer;
+    const Pipeline::Executor executor(factory());
+    const Sharded::Order order = state.range(1) ? Sharded::eUnordered : Sharded::eOrdered;
+
+    for (auto _ : state)
+    {
+        Sharded::Reader reader(files, order, state.range(0));
+        benchmark::DoNotOptimize(executor.run(reader, drawer).countRecords);
+    }
+    state.SetItemsProcessed(state.iterations() * countShards * (1 << 16));
+    state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(BM_ShardedRead)->ArgsProduct({ { 1, 4 }, { 0, 1 } })->UseRealTime();
+
+/*!
+     \brief Декодирование и отрисовка записей с префиксом длины: круги, эллипсы, ломаные из 8 вершин
+            и записи неизвестного типа. range(0) = 0 - эллипсы и ломаные не зарегистрированы
+            и пропускаются вместе с неизвестными, 1 - рисуются через таблицу фабрики
+ */
+static void BM_RuntimeFigures(benchmark::State &state)
+{
+    static const Figure::Factory withShapes = []()
+    {
+        Figure::Factory res;
+        Figure::Figures::registerFigures(res);
+        Shapes::registerShapes(res);
+        return res;
+    }();
+    const Figure::Factory &figureFactory = state.range(0) ? withShapes : factory();
+
+    Format::Format format;
+    format.header = true;
+    format.flags = Format::Format::eLengthPrefix;
+    const size_t COUNT_RECORDS = 1 << 16;
+    const Figure::Type types[] = { Figure::eCircle, Shapes::ELLIPSE_TYPE, Shapes::POLYLINE_TYPE, static_cast<Figure::Type>(99) };
+    const size_t countParams[] = { Figure::Circle::COUNT_PARAMS, Shapes::Ellipse::COUNT_PARAMS, 16, 5 };
+    std::vector<uint8_t> data;
+    format.writeHeader(data);
+    for (size_t i = 0; i < COUNT_RECORDS; ++i)
+    {
+        const size_t type = i % std::size(types);
+        double params[16];
+        for (size_t j = 0; j < countParams[type]; ++j)
+            params[j] = static_cast<double>(i + j);
+        const size_t pos = data.size();
+        data.resize(pos + format.recordSize(countParams[type]));
+        format.encodeRecord(types[type], params, countParams[type], 0, data.data() + pos);
+    }
+
+    const FeatureDecoder decoder(figureFactory, format);
+    const Testing::DrawerFake drawer;
+    FeatureBatch batch;
+    for (auto _ : state)
+    {
+        batch.clear();
+        decoder.decode(data, batch, 1);
+        batch.draw(drawer);
+    }
+    state.SetItemsProcessed(state.iterations() * COUNT_RECORDS);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_RuntimeFigures)->Arg(0)->Arg(1);
+
+/*!
+     \brief Отрисовщик с сетками, как GPU: данные сетки копируются в свои буферы, только когда меняется version
+ */
+class MeshDrawerFake : public Testing::DrawerFake
+{
+    struct Buffers
+    {
+        uint64_t version = 0;
+        std::vector<double> vertices;
+        std::vector<uint32_t> indices;
+    };
+    mutable std::map<uint64_t, Buffers> buffers;
+
+public:
+    bool hasMeshes() const override { return true; }
+    void drawMesh(const Drawer::Mesh &mesh) const override
+    {
+        Buffers &target = buffers[mesh.id];
+        if (target.version == mesh.version)
+            return;
+        target.version = mesh.version;
+        target.vertices.assign(mesh.vertices.begin(), mesh.vertices.end());
+        target.indices.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+    void releaseMesh(uint64_t id) const override { buffers.erase(id); }
+};
+
+/*!
+     \brief Отрисовка пакета треугольников и квадратов через Tessellation::Cache.
+            range(0) = 0 - кэш очищается каждый кадр: разбиение и загрузка заново, как без кэша,
+            1 - кадры после первого рисуют готовую сетку
+ */
+static void BM_TessellationCache(benchmark::State &state)
+{
+    Generator::Options options;
+    options.countRecords = 1 << 16;
+    options.mix = {{ 0, 1, 1 }};
+    const std::vector<uint8_t> data = Generator::Generator(options).generate();
+    FeatureBatch batch;
+    FeatureDecoder(factory()).decode(data, batch, 1);
+
+    const MeshDrawerFake drawer;
+    Tessellation::Cache cache;
+    for (auto _ : state)
+    {
+        if (!state.range(0))
+            cache.clear();
+        cache.draw(drawer, batch);
+    }
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_TessellationCache)->Arg(0)->Arg(1);
+
+/*!
+     \brief Прогон по внешнему файлу, например созданному ProSoft_generate
+ */
+static void BM_EndToEndFile(benchmark::State &state, const std::string &filename)
+{
+    const Testing::DrawerFake drawer;
+    const Pipeline::Executor executor(factory());
+    uint64_t countRecords = 0;
+    for (auto _ : state)
+    {
+        Reader::BufferedFile reader(filename, Reader::BufferedFile::DEFAULT_BLOCK_SIZE, true);
+        countRecords = executor.run(reader, drawer).countRecords;
+    }
+    state.SetItemsProcessed(state.iterations() * countRecords);
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(filename));
+}
+
+int main(int argc, char **argv)
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    // PROSOFT_BENCH_FILE - путь к файлу промышленного размера для сквозного замера
+    if (const char *filename = std::getenv("PROSOFT_BENCH_FILE"))
+        benchmark::RegisterBenchmark("BM_EndToEndFile", BM_EndToEndFile, std::string(filename))->UseRealTime();
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
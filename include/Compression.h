@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef PROSOFT_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef PROSOFT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef PROSOFT_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "Utils.h"
+
+namespace Compression
+{
+    /*!
+         \brief Алгоритмы сжатия блоков. Доступны те, с библиотеками которых собран проект
+     */
+    enum Codec : uint32_t
+    {
+        eNone,      ///< без сжатия
+        eLz4,
+        eZstd,
+        eDeflate,   ///< zlib
+
+        eCountCodecs ///< количество алгоритмов, не является алгоритмом
+    };
+
+    inline bool isAvailable(Codec codec)
+    {
+        switch (codec)
+        {
+        case eNone:
+            return true;
+#ifdef PROSOFT_HAVE_LZ4
+        case eLz4:
+            return true;
+#endif
+#ifdef PROSOFT_HAVE_ZSTD
+        case eZstd:
+            return true;
+#endif
+#ifdef PROSOFT_HAVE_ZLIB
+        case eDeflate:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    /*!
+         \brief Сжатие src в dst
+         \param level - уровень сжатия, 0 - по умолчанию для алгоритма
+         \return false, если алгоритм недоступен или произошла ошибка
+     */
+    inline bool compress(Codec codec, Utils::Span<const uint8_t> src, std::vector<uint8_t> &dst, int level = 0)
+    {
+        switch (codec)
+        {
+        case eNone:
+            dst.assign(src.begin(), src.end());
+            return true;
+#ifdef PROSOFT_HAVE_LZ4
+        case eLz4:
+        {
+            if (src.size() > LZ4_MAX_INPUT_SIZE)
+                return false;
+            dst.resize(LZ4_compressBound(static_cast<int>(src.size())));
+            const int res = LZ4_compress_default(reinterpret_cast<const char*>(src.data()), reinterpret_cast<char*>(dst.data()),
+                                                 static_cast<int>(src.size()), static_cast<int>(dst.size()));
+            dst.resize(res > 0 ? res : 0);
+            return res > 0;
+        }
+#endif
+#ifdef PROSOFT_HAVE_ZSTD
+        case eZstd:
+        {
+            dst.resize(ZSTD_compressBound(src.size()));
+            const size_t res = ZSTD_compress(dst.data(), dst.size(), src.data(), src.size(), level ? level : 3);
+            dst.resize(ZSTD_isError(res) ? 0 : res);
+            return !ZSTD_isError(res);
+        }
+#endif
+#ifdef PROSOFT_HAVE_ZLIB
+        case eDeflate:
+        {
+            uLongf size = ::compressBound(static_cast<uLong>(src.size()));
+            dst.resize(size);
+            const int res = ::compress2(dst.data(), &size, src.data(), static_cast<uLong>(src.size()),
+                                        level ? level : Z_DEFAULT_COMPRESSION);
+            dst.resize(res == Z_OK ? size : 0);
+            return res == Z_OK;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    /*!
+         \brief Распаковка src в dst размером ровно rawSize байт
+         \return false, если алгоритм недоступен, данные испорчены или размер не совпал
+     */
+    inline bool decompress(Codec codec, Utils::Span<const uint8_t> src, uint8_t *dst, size_t rawSize)
+    {
+        switch (codec)
+        {
+        case eNone:
+            if (src.size() != rawSize)
+                return false;
+            if (rawSize)
+                memcpy(dst, src.data(), rawSize);
+            return true;
+#ifdef PROSOFT_HAVE_LZ4
+        case eLz4:
+            return src.size() <= LZ4_MAX_INPUT_SIZE && rawSize <= LZ4_MAX_INPUT_SIZE
+                && LZ4_decompress_safe(reinterpret_cast<const char*>(src.data()), reinterpret_cast<char*>(dst),
+                                       static_cast<int>(src.size()), static_cast<int>(rawSize)) == static_cast<int>(rawSize);
+#endif
+#ifdef PROSOFT_HAVE_ZSTD
+        case eZstd:
+            return ZSTD_decompress(dst, rawSize, src.data(), src.size()) == rawSize;
+#endif
+#ifdef PROSOFT_HAVE_ZLIB
+        case eDeflate:
+        {
+            uLongf size = static_cast<uLongf>(rawSize);
+            return ::uncompress(dst, &size, src.data(), static_cast<uLong>(src.size())) == Z_OK && size == rawSize;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    /*!
+         \brief Контейнер из независимо сжатых блоков. Начинается с заголовка
+                    char magic[4] "PSBC", uint32 version, uint32 codec, uint32 flags,
+                затем блоки: BlockHeader и codec-сжатые rawSize байт.
+                Распакованные блоки подряд дают исходный файл записей вместе с его заголовком
+                формата, каждый блок содержит только целые записи
+     */
+    constexpr char MAGIC[4] = { 'P', 'S', 'B', 'C' };
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 3 * sizeof(uint32_t);
+    constexpr uint32_t MAX_BLOCK_SIZE = 1u << 30;
+
+    struct BlockHeader
+    {
+        uint32_t codec = eNone;     ///< алгоритм блока: несжимаемые блоки хранятся как есть
+        uint32_t rawSize = 0;
+        uint32_t compressedSize = 0;
+        uint32_t countRecords = 0;
+    };
+    static_assert(sizeof(BlockHeader) == 16, "BlockHeader must be packed");
+
+    /*!
+         \brief Является ли файл контейнером сжатых блоков
+     */
+    inline bool isContainer(const std::string &filename)
+    {
+        char magic[sizeof(MAGIC)];
+        FILE *file = ::fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+        const bool res = ::fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        ::fclose(file);
+        return res;
+    }
+
+    /*!
+         \brief Запись контейнера сжатых блоков
+     */
+    class Writer
+    {
+        FILE *file;
+        Codec codec;
+        int level;
+        std::vector<uint8_t> compressed;
+
+        bool write(const void *src, size_t size) { return !size || ::fwrite(src, size, 1, file) == 1; }
+
+    public:
+        /*!
+             \param file - открытый на запись файл, которым Writer не владеет
+         */
+        Writer(FILE *file_, Codec codec_, int level_ = 0)
+            : file(file_),
+              codec(codec_),
+              level(level_)
+        {
+        }
+        bool writeHeader()
+        {
+            const uint32_t fields[] = { VERSION, codec, 0 };
+            return isAvailable(codec) && write(MAGIC, sizeof(MAGIC)) && write(fields, sizeof(fields));
+        }
+        /*!
+             \brief Сжатие и запись блока целых записей
+         */
+        bool writeBlock(Utils::Span<const uint8_t> raw, uint32_t countRecords)
+        {
+            if (raw.size() > MAX_BLOCK_SIZE)
+                return false;
+
+            BlockHeader header;
+            header.codec = codec;
+            header.rawSize = static_cast<uint32_t>(raw.size());
+            header.countRecords = countRecords;
+            if (!compress(codec, raw, compressed, level))
+                return false;
+            if (codec != eNone && compressed.size() >= raw.size())
+            {
+                header.codec = eNone;
+                compressed.assign(raw.begin(), raw.end());
+            }
+            header.compressedSize = static_cast<uint32_t>(compressed.size());
+            return write(&header, sizeof(header)) && write(compressed.data(), compressed.size());
+        }
+    };
+}
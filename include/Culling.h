@@ -0,0 +1,446 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "Feature.h"
+#include "Metrics.h"
+#include "Simd.h"
+#include "Utils.h"
+
+namespace Culling
+{
+    /*!
+         \brief Ограничивающие прямоугольники группы фигур, колонками
+     */
+    struct Bounds
+    {
+        std::vector<double> minX;
+        std::vector<double> minY;
+        std::vector<double> maxX;
+        std::vector<double> maxY;
+
+        size_t size() const { return minX.size(); }
+        void resize(size_t size)
+        {
+            minX.resize(size);
+            minY.resize(size);
+            maxX.resize(size);
+            maxY.resize(size);
+        }
+        Utils::Rect rect(size_t index) const { return { minX[index], minY[index], maxX[index], maxY[index] }; }
+    };
+
+    /*!
+         \brief Векторные ядра. Обрабатывают столько элементов, сколько помещается в регистр,
+                и возвращают индекс первого необработанного элемента для скалярного хвоста
+     */
+    namespace Kernels
+    {
+#if defined(PROSOFT_SIMD_AVX2)
+        /*!
+             \brief Минимум и максимум координат вершин для 4 многоугольников начиная с first.
+                    Вершина k многоугольника i: points[(first + i) * countParams + 2k]
+         */
+        inline void poligonBounds4(const double *points, size_t first, size_t countParams,
+                                   __m256d &minX, __m256d &minY, __m256d &maxX, __m256d &maxY)
+        {
+            const long long stride = static_cast<long long>(countParams);
+            const __m256i index = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+            const double *base = points + first * countParams;
+            minX = maxX = _mm256_i64gather_pd(base, index, 8);
+            minY = maxY = _mm256_i64gather_pd(base + 1, index, 8);
+            for (size_t k = 2; k < countParams; k += 2)
+            {
+                const __m256d x = _mm256_i64gather_pd(base + k, index, 8);
+                const __m256d y = _mm256_i64gather_pd(base + k + 1, index, 8);
+                minX = _mm256_min_pd(minX, x);
+                maxX = _mm256_max_pd(maxX, x);
+                minY = _mm256_min_pd(minY, y);
+                maxY = _mm256_max_pd(maxY, y);
+            }
+        }
+        inline uint64_t intersects4(__m256d minX, __m256d minY, __m256d maxX, __m256d maxY, const Utils::Rect &rect)
+        {
+            const __m256d visible = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(maxX, _mm256_set1_pd(rect.minX), _CMP_GE_OQ),
+                              _mm256_cmp_pd(minX, _mm256_set1_pd(rect.maxX), _CMP_LE_OQ)),
+                _mm256_and_pd(_mm256_cmp_pd(maxY, _mm256_set1_pd(rect.minY), _CMP_GE_OQ),
+                              _mm256_cmp_pd(minY, _mm256_set1_pd(rect.maxY), _CMP_LE_OQ)));
+            return static_cast<uint64_t>(_mm256_movemask_pd(visible));
+        }
+        inline size_t circlesVisible(const FeatureBatch::Circles &circles, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 4 <= circles.size(); i += 4)
+            {
+                const __m256d x = _mm256_loadu_pd(circles.centerX.data() + i);
+                const __m256d y = _mm256_loadu_pd(circles.centerY.data() + i);
+                const __m256d r = _mm256_loadu_pd(circles.radius.data() + i);
+                visible.setBits(i, intersects4(_mm256_sub_pd(x, r), _mm256_sub_pd(y, r),
+                                               _mm256_add_pd(x, r), _mm256_add_pd(y, r), rect));
+            }
+            return i;
+        }
+        inline size_t poligonsVisible(const FeatureBatch::Poligons &group, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 4 <= group.size(); i += 4)
+            {
+                __m256d minX, minY, maxX, maxY;
+                poligonBounds4(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                visible.setBits(i, intersects4(minX, minY, maxX, maxY, rect));
+            }
+            return i;
+        }
+        inline size_t circlesBounds(const FeatureBatch::Circles &circles, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 4 <= circles.size(); i += 4)
+            {
+                const __m256d x = _mm256_loadu_pd(circles.centerX.data() + i);
+                const __m256d y = _mm256_loadu_pd(circles.centerY.data() + i);
+                const __m256d r = _mm256_loadu_pd(circles.radius.data() + i);
+                _mm256_storeu_pd(bounds.minX.data() + i, _mm256_sub_pd(x, r));
+                _mm256_storeu_pd(bounds.minY.data() + i, _mm256_sub_pd(y, r));
+                _mm256_storeu_pd(bounds.maxX.data() + i, _mm256_add_pd(x, r));
+                _mm256_storeu_pd(bounds.maxY.data() + i, _mm256_add_pd(y, r));
+            }
+            return i;
+        }
+        inline size_t poligonsBounds(const FeatureBatch::Poligons &group, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 4 <= group.size(); i += 4)
+            {
+                __m256d minX, minY, maxX, maxY;
+                poligonBounds4(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                _mm256_storeu_pd(bounds.minX.data() + i, minX);
+                _mm256_storeu_pd(bounds.minY.data() + i, minY);
+                _mm256_storeu_pd(bounds.maxX.data() + i, maxX);
+                _mm256_storeu_pd(bounds.maxY.data() + i, maxY);
+            }
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_SSE2)
+        /*!
+             \brief Минимум и максимум координат вершин для 2 многоугольников начиная с first
+         */
+        inline void poligonBounds2(const double *points, size_t first, size_t countParams,
+                                   __m128d &minX, __m128d &minY, __m128d &maxX, __m128d &maxY)
+        {
+            const double *p0 = points + first * countParams;
+            const double *p1 = p0 + countParams;
+            // пары (x, y) двух многоугольников, переставленные в (x0, x1) и (y0, y1)
+            __m128d a = _mm_loadu_pd(p0);
+            __m128d b = _mm_loadu_pd(p1);
+            minX = maxX = _mm_unpacklo_pd(a, b);
+            minY = maxY = _mm_unpackhi_pd(a, b);
+            for (size_t k = 2; k < countParams; k += 2)
+            {
+                a = _mm_loadu_pd(p0 + k);
+                b = _mm_loadu_pd(p1 + k);
+                const __m128d x = _mm_unpacklo_pd(a, b);
+                const __m128d y = _mm_unpackhi_pd(a, b);
+                minX = _mm_min_pd(minX, x);
+                maxX = _mm_max_pd(maxX, x);
+                minY = _mm_min_pd(minY, y);
+                maxY = _mm_max_pd(maxY, y);
+            }
+        }
+        inline uint64_t intersects2(__m128d minX, __m128d minY, __m128d maxX, __m128d maxY, const Utils::Rect &rect)
+        {
+            const __m128d visible = _mm_and_pd(
+                _mm_and_pd(_mm_cmpge_pd(maxX, _mm_set1_pd(rect.minX)), _mm_cmple_pd(minX, _mm_set1_pd(rect.maxX))),
+                _mm_and_pd(_mm_cmpge_pd(maxY, _mm_set1_pd(rect.minY)), _mm_cmple_pd(minY, _mm_set1_pd(rect.maxY))));
+            return static_cast<uint64_t>(_mm_movemask_pd(visible));
+        }
+        inline size_t circlesVisible(const FeatureBatch::Circles &circles, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const __m128d x = _mm_loadu_pd(circles.centerX.data() + i);
+                const __m128d y = _mm_loadu_pd(circles.centerY.data() + i);
+                const __m128d r = _mm_loadu_pd(circles.radius.data() + i);
+                visible.setBits(i, intersects2(_mm_sub_pd(x, r), _mm_sub_pd(y, r), _mm_add_pd(x, r), _mm_add_pd(y, r), rect));
+            }
+            return i;
+        }
+        inline size_t poligonsVisible(const FeatureBatch::Poligons &group, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                __m128d minX, minY, maxX, maxY;
+                poligonBounds2(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                visible.setBits(i, intersects2(minX, minY, maxX, maxY, rect));
+            }
+            return i;
+        }
+        inline size_t circlesBounds(const FeatureBatch::Circles &circles, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const __m128d x = _mm_loadu_pd(circles.centerX.data() + i);
+                const __m128d y = _mm_loadu_pd(circles.centerY.data() + i);
+                const __m128d r = _mm_loadu_pd(circles.radius.data() + i);
+                _mm_storeu_pd(bounds.minX.data() + i, _mm_sub_pd(x, r));
+                _mm_storeu_pd(bounds.minY.data() + i, _mm_sub_pd(y, r));
+                _mm_storeu_pd(bounds.maxX.data() + i, _mm_add_pd(x, r));
+                _mm_storeu_pd(bounds.maxY.data() + i, _mm_add_pd(y, r));
+            }
+            return i;
+        }
+        inline size_t poligonsBounds(const FeatureBatch::Poligons &group, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                __m128d minX, minY, maxX, maxY;
+                poligonBounds2(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                _mm_storeu_pd(bounds.minX.data() + i, minX);
+                _mm_storeu_pd(bounds.minY.data() + i, minY);
+                _mm_storeu_pd(bounds.maxX.data() + i, maxX);
+                _mm_storeu_pd(bounds.maxY.data() + i, maxY);
+            }
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_NEON)
+        /*!
+             \brief Минимум и максимум координат вершин для 2 многоугольников начиная с first
+         */
+        inline void poligonBounds2(const double *points, size_t first, size_t countParams,
+                                   float64x2_t &minX, float64x2_t &minY, float64x2_t &maxX, float64x2_t &maxY)
+        {
+            const double *p0 = points + first * countParams;
+            const double *p1 = p0 + countParams;
+            // пары (x, y) двух многоугольников, переставленные в (x0, x1) и (y0, y1)
+            float64x2_t a = vld1q_f64(p0);
+            float64x2_t b = vld1q_f64(p1);
+            minX = maxX = vzip1q_f64(a, b);
+            minY = maxY = vzip2q_f64(a, b);
+            for (size_t k = 2; k < countParams; k += 2)
+            {
+                a = vld1q_f64(p0 + k);
+                b = vld1q_f64(p1 + k);
+                const float64x2_t x = vzip1q_f64(a, b);
+                const float64x2_t y = vzip2q_f64(a, b);
+                minX = vminq_f64(minX, x);
+                maxX = vmaxq_f64(maxX, x);
+                minY = vminq_f64(minY, y);
+                maxY = vmaxq_f64(maxY, y);
+            }
+        }
+        inline uint64_t intersects2(float64x2_t minX, float64x2_t minY, float64x2_t maxX, float64x2_t maxY, const Utils::Rect &rect)
+        {
+            const uint64x2_t visible = vandq_u64(
+                vandq_u64(vcgeq_f64(maxX, vdupq_n_f64(rect.minX)), vcleq_f64(minX, vdupq_n_f64(rect.maxX))),
+                vandq_u64(vcgeq_f64(maxY, vdupq_n_f64(rect.minY)), vcleq_f64(minY, vdupq_n_f64(rect.maxY))));
+            return (vgetq_lane_u64(visible, 0) & 1) | ((vgetq_lane_u64(visible, 1) & 1) << 1);
+        }
+        inline size_t circlesVisible(const FeatureBatch::Circles &circles, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const float64x2_t x = vld1q_f64(circles.centerX.data() + i);
+                const float64x2_t y = vld1q_f64(circles.centerY.data() + i);
+                const float64x2_t r = vld1q_f64(circles.radius.data() + i);
+                visible.setBits(i, intersects2(vsubq_f64(x, r), vsubq_f64(y, r), vaddq_f64(x, r), vaddq_f64(y, r), rect));
+            }
+            return i;
+        }
+        inline size_t poligonsVisible(const FeatureBatch::Poligons &group, const Utils::Rect &rect, Utils::Bitmap &visible)
+        {
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                float64x2_t minX, minY, maxX, maxY;
+                poligonBounds2(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                visible.setBits(i, intersects2(minX, minY, maxX, maxY, rect));
+            }
+            return i;
+        }
+        inline size_t circlesBounds(const FeatureBatch::Circles &circles, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const float64x2_t x = vld1q_f64(circles.centerX.data() + i);
+                const float64x2_t y = vld1q_f64(circles.centerY.data() + i);
+                const float64x2_t r = vld1q_f64(circles.radius.data() + i);
+                vst1q_f64(bounds.minX.data() + i, vsubq_f64(x, r));
+                vst1q_f64(bounds.minY.data() + i, vsubq_f64(y, r));
+                vst1q_f64(bounds.maxX.data() + i, vaddq_f64(x, r));
+                vst1q_f64(bounds.maxY.data() + i, vaddq_f64(y, r));
+            }
+            return i;
+        }
+        inline size_t poligonsBounds(const FeatureBatch::Poligons &group, Bounds &bounds)
+        {
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                float64x2_t minX, minY, maxX, maxY;
+                poligonBounds2(group.points.data(), i, group.countParams, minX, minY, maxX, maxY);
+                vst1q_f64(bounds.minX.data() + i, minX);
+                vst1q_f64(bounds.minY.data() + i, minY);
+                vst1q_f64(bounds.maxX.data() + i, maxX);
+                vst1q_f64(bounds.maxY.data() + i, maxY);
+            }
+            return i;
+        }
+#else
+        inline size_t circlesVisible(const FeatureBatch::Circles &, const Utils::Rect &, Utils::Bitmap &) { return 0; }
+        inline size_t poligonsVisible(const FeatureBatch::Poligons &, const Utils::Rect &, Utils::Bitmap &) { return 0; }
+        inline size_t circlesBounds(const FeatureBatch::Circles &, Bounds &) { return 0; }
+        inline size_t poligonsBounds(const FeatureBatch::Poligons &, Bounds &) { return 0; }
+#endif
+    }
+
+    /*!
+         \brief Ограничивающий прямоугольник круга
+     */
+    inline Utils::Rect circleBounds(const FeatureBatch::Circles &circles, size_t index)
+    {
+        const double x = circles.centerX[index];
+        const double y = circles.centerY[index];
+        const double r = circles.radius[index];
+        return { x - r, y - r, x + r, y + r };
+    }
+    /*!
+         \brief Ограничивающий прямоугольник многоугольника
+     */
+    inline Utils::Rect poligonBounds(const FeatureBatch::Poligons &group, size_t index)
+    {
+        const Utils::Span<const double> points = group.poligon(index);
+        Utils::Rect res = { points[0], points[1], points[0], points[1] };
+        for (size_t k = 2; k < points.size(); k += 2)
+            res.unite({ points[k], points[k + 1], points[k], points[k + 1] });
+        return res;
+    }
+
+    /*!
+         \brief Ограничивающий прямоугольник фигуры группы others: рамка точек x, y, расширенная
+                на наибольшую длину. Длины отличаются от координат по Figure::Figure::lengthParams(),
+                так что для эллипса это описанный квадрат, а для ломаной - рамка вершин.
+                Фигура без точек считается занимающей всю плоскость
+     */
+    inline Utils::Rect recordBounds(const FeatureBatch::Group &group, size_t index)
+    {
+        const Utils::Span<const double> params = group.record(index);
+        const uint32_t lengthParams = group.figure->lengthParams();
+        const auto isLength = [lengthParams](size_t k) { return k < 32 && (lengthParams & (1u << k)); };
+        const double infinity = std::numeric_limits<double>::infinity();
+        Utils::Rect res = { infinity, infinity, -infinity, -infinity };
+        double extent = 0;
+        for (size_t k = 0; k < params.size(); ++k)
+        {
+            if (isLength(k))
+            {
+                extent = std::max(extent, std::fabs(params[k]));
+            }
+            else if (k % 2 == 0 && k + 1 < params.size() && !isLength(k + 1))
+            {
+                res.unite({ params[k], params[k + 1], params[k], params[k + 1] });
+                ++k;
+            }
+        }
+        if (res.minX > res.maxX)
+            return { -infinity, -infinity, infinity, infinity };
+        return { res.minX - extent, res.minY - extent, res.maxX + extent, res.maxY + extent };
+    }
+
+    /*!
+         \brief Ограничивающие прямоугольники всех кругов группы
+     */
+    inline void bounds(const FeatureBatch::Circles &circles, Bounds &res)
+    {
+        res.resize(circles.size());
+        for (size_t i = Kernels::circlesBounds(circles, res); i < circles.size(); ++i)
+        {
+            const Utils::Rect rect = circleBounds(circles, i);
+            res.minX[i] = rect.minX;
+            res.minY[i] = rect.minY;
+            res.maxX[i] = rect.maxX;
+            res.maxY[i] = rect.maxY;
+        }
+    }
+    /*!
+         \brief Ограничивающие прямоугольники всех многоугольников группы
+     */
+    inline void bounds(const FeatureBatch::Poligons &group, Bounds &res)
+    {
+        res.resize(group.size());
+        for (size_t i = Kernels::poligonsBounds(group, res); i < group.size(); ++i)
+        {
+            const Utils::Rect rect = poligonBounds(group, i);
+            res.minX[i] = rect.minX;
+            res.minY[i] = rect.minY;
+            res.maxX[i] = rect.maxX;
+            res.maxY[i] = rect.maxY;
+        }
+    }
+
+    /*!
+         \brief Отсечение фигур, не пересекающих видимую область
+     */
+    class Viewport
+    {
+        Utils::Rect _rect;
+
+    public:
+        explicit Viewport(const Utils::Rect &rect_)
+            : _rect(rect_)
+        {
+        }
+        const Utils::Rect &rect() const { return _rect; }
+
+        /*!
+             \brief Отметка видимых фигур пакета
+         */
+        void select(const FeatureBatch &batch, FeatureBatch::Selection &visible) const
+        {
+            visible.circles.assign(batch.circles.size(), false);
+            for (size_t i = Kernels::circlesVisible(batch.circles, _rect, visible.circles); i < batch.circles.size(); ++i)
+                visible.circles.set(i, circleBounds(batch.circles, i).intersects(_rect));
+
+            select(batch.triangles, visible.triangles);
+            select(batch.squares, visible.squares);
+            visible.others.resize(batch.others.size());
+            for (size_t i = 0; i < batch.others.size(); ++i)
+            {
+                const FeatureBatch::Group &group = batch.others[i];
+                visible.others[i].assign(group.size(), false);
+                for (size_t k = 0; k < group.size(); ++k)
+                    visible.others[i].set(k, recordBounds(group, k).intersects(_rect));
+            }
+        }
+        /*!
+             \brief Удаление из пакета невидимых фигур
+             \return количество удаленных фигур
+         */
+        size_t cull(FeatureBatch &batch) const
+        {
+            FeatureBatch::Selection visible;
+            select(batch, visible);
+            const size_t countBefore = batch.size();
+            batch.filter(visible);
+            PROSOFT_COUNT(eFiguresCulled, countBefore - batch.size());
+            return countBefore - batch.size();
+        }
+
+    private:
+        void select(const FeatureBatch::Poligons &group, Utils::Bitmap &visible) const
+        {
+            visible.assign(group.size(), false);
+            for (size_t i = Kernels::poligonsVisible(group, _rect, visible); i < group.size(); ++i)
+                visible.set(i, poligonBounds(group, i).intersects(_rect));
+        }
+    };
+}
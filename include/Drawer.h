@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Utils.h"
+
+namespace Drawer
+{
+    /*!
+         \brief Треугольная сетка многоугольников для отрисовки без разбиения на треугольники.
+                Вершины x0, y0, x1, y1, ..., по три индекса вершин на треугольник.
+                Сетка с тем же id между кадрами хранит те же данные, пока не вырастет version
+     */
+    struct Mesh
+    {
+        uint64_t id = 0;
+        uint64_t version = 0;
+        Utils::Span<const double> vertices;
+        Utils::Span<const uint32_t> indices;
+    };
+
+    /*!
+         \brief Интерфейс к объекту с базовыми методами отрисовки
+     */
+    class IDrawer
+    {
+    public:
+        virtual ~IDrawer() = default;
+        virtual void drawCircle(double centerX, double centerY, double radius) const = 0;
+        virtual void drawPoligon(Utils::Span<const double> points) const = 0;
+        /*!
+             \brief Методы можно вызывать одновременно из нескольких потоков.
+                    Тогда пакеты рисуются кусками задачами общего пула, см. FeatureBatch::draw()
+         */
+        virtual bool isThreadSafe() const { return false; }
+        /*!
+             \brief Реализация рисует сетки drawMesh() сама, например загружая их в буферы GPU.
+                    Тогда многоугольники пакетов разбиваются на треугольники один раз
+                    и берутся из кэша, см. Tessellation::Cache
+         */
+        virtual bool hasMeshes() const { return false; }
+        /*!
+             \brief Отрисовка сетки. Данные сетки стоит загружать заново, только если
+                    для mesh.id пришла новая mesh.version. По умолчанию каждый треугольник
+                    рисуется как многоугольник
+         */
+        virtual void drawMesh(const Mesh &mesh) const
+        {
+            std::vector<double> points;
+            std::vector<uint32_t> offsets{0};
+            for (size_t i = 0; i < mesh.indices.size() / 3 * 3; ++i)
+            {
+                const uint32_t vertex = mesh.indices[i];
+                points.push_back(mesh.vertices[2 * vertex]);
+                points.push_back(mesh.vertices[2 * vertex + 1]);
+                if (i % 3 == 2)
+                    offsets.push_back(static_cast<uint32_t>(points.size()));
+            }
+            drawPoligons(points, offsets);
+        }
+        /*!
+             \brief Сетка id больше не будет рисоваться, ее буферы можно освободить
+         */
+        virtual void releaseMesh(uint64_t /*id*/) const {}
+
+        /*!
+             \brief Отрисовка пакета кругов. Колонки имеют одинаковую длину.
+                    По умолчанию сводится к поштучным вызовам drawCircle()
+         */
+        virtual void drawCircles(Utils::Span<const double> centerX,
+                                 Utils::Span<const double> centerY,
+                                 Utils::Span<const double> radius) const
+        {
+            for (size_t i = 0; i < centerX.size(); ++i)
+                drawCircle(centerX[i], centerY[i], radius[i]);
+        }
+        /*!
+             \brief Отрисовка пакета многоугольников.
+                    Многоугольник i занимает points[offsets[i], offsets[i + 1]),
+                    поэтому offsets содержит на один элемент больше, чем многоугольников.
+                    По умолчанию сводится к поштучным вызовам drawPoligon()
+         */
+        virtual void drawPoligons(Utils::Span<const double> points, Utils::Span<const uint32_t> offsets) const
+        {
+            for (size_t i = 0; i + 1 < offsets.size(); ++i)
+                drawPoligon(points.subspan(offsets[i], offsets[i + 1] - offsets[i]));
+        }
+        /*!
+             \brief Отрисовка незамкнутой ломаной x0, y0, x1, y1, ...
+                    По умолчанию - многоугольник, обходящий вершины туда и обратно:
+                    его контур совпадает с ломаной, а площадь нулевая
+         */
+        virtual void drawPolyline(Utils::Span<const double> points) const
+        {
+            std::vector<double> there(points.begin(), points.end());
+            for (size_t i = points.size() / 2; i-- > 2;)
+            {
+                there.push_back(points[2 * (i - 1)]);
+                there.push_back(points[2 * (i - 1) + 1]);
+            }
+            drawPoligon(Utils::Span<const double>(there.data(), there.size()));
+        }
+        /*!
+             \brief Отрисовка пакета ломаных, смещения как в drawPoligons().
+                    По умолчанию сводится к поштучным вызовам drawPolyline()
+         */
+        virtual void drawPolylines(Utils::Span<const double> points, Utils::Span<const uint32_t> offsets) const
+        {
+            for (size_t i = 0; i + 1 < offsets.size(); ++i)
+                drawPolyline(points.subspan(offsets[i], offsets[i + 1] - offsets[i]));
+        }
+    };
+
+    /*!
+         \brief Переходник для реализаций с прежней сигнатурой drawPoligon(const std::vector<double>&).
+                Оставлен на один выпуск, затем будет удален: переопределяйте IDrawer::drawPoligon(Utils::Span)
+     */
+    class [[deprecated("override IDrawer::drawPoligon(Utils::Span<const double>)")]] LegacyDrawer : public IDrawer
+    {
+    public:
+        virtual void drawPoligon(const std::vector<double> &points) const = 0;
+        void drawPoligon(Utils::Span<const double> points) const override
+        {
+            drawPoligon(std::vector<double>(points.begin(), points.end()));
+        }
+    };
+
+    /*!
+         \brief Объект-рисовальщик
+     */
+    class Drawer : public IDrawer
+    {
+    public:
+        void drawCircle(double /*centerX*/, double /*centerY*/, double /*radius*/) const
+        {
+           // ...
+        }
+        void drawPoligon(Utils::Span<const double> /*points*/) const
+        {
+           // ...
+        }
+        void drawCircles(Utils::Span<const double> /*centerX*/,
+                         Utils::Span<const double> /*centerY*/,
+                         Utils::Span<const double> /*radius*/) const override
+        {
+           // ...
+        }
+        void drawPoligons(Utils::Span<const double> /*points*/, Utils::Span<const uint32_t> /*offsets*/) const override
+        {
+           // ...
+        }
+        void drawPolylines(Utils::Span<const double> /*points*/, Utils::Span<const uint32_t> /*offsets*/) const override
+        {
+           // ...
+        }
+    };
+}
@@ -0,0 +1,1020 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <variant>
+#include <vector>
+
+#include "Drawer.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Metrics.h"
+#include "Reader.h"
+#include "Scheduler.h"
+#include "Utils.h"
+
+/*!
+     \brief Класс, реализующий чтение данных, создание объекта фигуры и отрисовку
+ */
+class Feature
+{
+    const Figure::Factory &figureFactory;
+    Format::Format dataFormat;
+
+    const Figure::Figure *currentFigure = nullptr;
+    std::vector<double> currentParams;        ///< буфер для параметров, если источник не отдает их без копирования
+    std::vector<uint8_t> currentEncoded;      ///< буфер для параметров в компактном представлении
+    Utils::Span<const double> currentView;    ///< параметры текущей фигуры
+    Utils::Arena *paramsArena = nullptr;      ///< хранилище параметров, если задано через setArena()
+    size_t currentExtra = 0;                  ///< байт расширения текущей записи после параметров фигуры
+    uint64_t currentSkipped = 0;              ///< байт пропущенных записей перед текущей
+    bool ended = false;                       ///< последний read() не нашел начала новой записи
+
+    /*!
+         \brief Место под параметры текущей записи: общий буфер или новый участок арены
+     */
+    double *storage(size_t countParams)
+    {
+        if (paramsArena)
+            return paramsArena->allocate<double>(countParams);
+        currentParams.resize(countParams);
+        return currentParams.data();
+    }
+    /*!
+         \brief Чтение параметров в компактном представлении с восстановлением в double
+     */
+    bool readEncoded(const Reader::IReader &reader, const Figure::Figure &figure, size_t countParams)
+    {
+        const size_t paramSize = dataFormat.paramSize();
+        const void *data = reader.view(paramSize, countParams);
+        if (!data)
+        {
+            currentEncoded.resize(paramSize * countParams);
+            if (!reader.read(currentEncoded.data(), paramSize, countParams))
+                return false;
+            data = currentEncoded.data();
+        }
+        double *params = storage(countParams);
+        dataFormat.decode(data, countParams, figure.lengthParams(), params);
+        currentView = Utils::Span<const double>(params, countParams);
+        return true;
+    }
+    /*!
+         \brief Чтение параметров как есть. Без арены параметры по возможности
+                не копируются, а указывают прямо в память источника
+     */
+    bool readRaw(const Reader::IReader &reader, size_t countParams)
+    {
+        using paramType = decltype(currentParams)::value_type;
+        const void *data = paramsArena ? nullptr : reader.view(sizeof(paramType), countParams);
+        if (data && Utils::isAligned<paramType>(data))
+        {
+            currentView = Utils::Span<const paramType>(static_cast<const paramType*>(data), countParams);
+            return true;
+        }
+
+        paramType *params = storage(countParams);
+        if (data)
+            memcpy(params, data, sizeof(paramType) * countParams);
+        else if (!reader.read(params, sizeof(paramType), countParams))
+            return false;
+        currentView = Utils::Span<const paramType>(params, countParams);
+        return true;
+    }
+    bool readPrefixed(const Reader::IReader &reader)
+    {
+        currentSkipped = 0;
+        while (true)
+        {
+            Figure::Type type;
+            uint32_t length = 0;
+            if (!reader.read(&type, sizeof(type)))
+            {
+                ended = true;
+                return false;
+            }
+            if (!reader.read(&length, sizeof(length)))
+            {
+                PROSOFT_COUNT(eRecordsRejected, 1);
+                currentFigure = nullptr;
+                return false;
+            }
+
+            const Figure::Figure *figure = figureFactory.prototype(type);
+            if (!figure)
+            {
+                PROSOFT_COUNT(ePrototypeMisses, 1);
+                if (!Reader::skip(reader, length))
+                {
+                    PROSOFT_COUNT(eRecordsRejected, 1);
+                    return false;
+                }
+                PROSOFT_COUNT(eRecordsSkipped, 1);
+                currentSkipped += dataFormat.prefixSize() + length;
+                continue;
+            }
+            PROSOFT_COUNT(ePrototypeHits, 1);
+
+            size_t countParams = 0;
+            bool res = dataFormat.countParams(figure->countParams(), length, countParams);
+            currentExtra = res ? length - countParams * dataFormat.paramSize() : 0;
+            res = res && (dataFormat.isRaw() ? readRaw(reader, countParams) : readEncoded(reader, *figure, countParams))
+                && (!currentExtra || Reader::skip(reader, currentExtra));
+            if (!res)
+            {
+                PROSOFT_COUNT(eRecordsRejected, 1);
+                currentFigure = nullptr;
+                return false;
+            }
+            currentFigure = figure;
+            return true;
+        }
+    }
+
+public:
+    /*!
+         \param format - формат записей источника, по умолчанию исходный
+     */
+    Feature(const Figure::Factory &figureFactory, const Format::Format &format = Format::Format())
+        : figureFactory(figureFactory),
+          dataFormat(format)
+    {
+    }
+    /*!
+         \brief Размещение параметров каждой следующей записи в арене.
+                Тогда params() остаются действительными до arena->reset(), а не до следующего read(),
+                что позволяет накопить пакет записей без копирования и освобождать его разом.
+                nullptr - вернуться к общему буферу
+     */
+    void setArena(Utils::Arena *arena) { paramsArena = arena; }
+
+    /*!
+         \brief Чтение следующей записи. В формате с префиксом длины записи
+                незарегистрированных типов пропускаются, а не прерывают чтение
+     */
+    bool read(const Reader::IReader &reader)
+    {
+        ended = false;
+        if (dataFormat.hasLengthPrefix())
+            return readPrefixed(reader);
+
+        Figure::Type type;
+        if (!reader.read(&type, sizeof(type)))
+        {
+            ended = true;
+            return false;
+        }
+
+        const Figure::Figure *figure = figureFactory.prototype(type);
+        if (!figure)
+        {
+            PROSOFT_COUNT(ePrototypeMisses, 1);
+            PROSOFT_COUNT(eRecordsRejected, 1);
+            return false;
+        }
+        PROSOFT_COUNT(ePrototypeHits, 1);
+
+        // без префикса длины число параметров переменной фигуры неизвестно
+        const size_t countParams = figure->countParams();
+        if (!countParams || !(dataFormat.isRaw() ? readRaw(reader, countParams) : readEncoded(reader, *figure, countParams)))
+        {
+            PROSOFT_COUNT(eRecordsRejected, 1);
+            currentFigure = nullptr;
+            return false;
+        }
+        currentFigure = figure;
+        return true;
+    }
+    void draw(const Drawer::IDrawer &drawer) const
+    {
+        if (!currentFigure)
+            return;
+        PROSOFT_COUNT(eDrawCalls, 1);
+        PROSOFT_COUNT(eFiguresDrawn, 1);
+        currentFigure->draw(drawer, currentView);
+    }
+    /*!
+         \brief Отрисовка без виртуального вызова через набор фигур Figure::Engine<...>.
+                Фигуры вне набора рисуются виртуальным вызовом
+     */
+    template <typename FigureEngine>
+    void draw(const Drawer::IDrawer &drawer) const
+    {
+        if (!currentFigure)
+            return;
+        PROSOFT_COUNT(eDrawCalls, 1);
+        PROSOFT_COUNT(eFiguresDrawn, 1);
+        if (!FigureEngine::draw(currentFigure->type(), drawer, currentView))
+            currentFigure->draw(drawer, currentView);
+    }
+    /*!
+         \brief Последний read() вернул false, потому что данные кончились до начала новой записи,
+                а не из-за испорченной или неизвестной записи
+     */
+    bool isEnd() const { return ended; }
+    /*!
+         \brief Текущая фигура или nullptr, если запись не прочитана
+     */
+    const Figure::Figure *figure() const { return currentFigure; }
+    const Format::Format &format() const { return dataFormat; }
+    /*!
+         \brief Размер текущей записи в источнике вместе с типом и префиксом длины
+     */
+    size_t recordSize() const { return dataFormat.recordSize(currentView.size()) + currentExtra; }
+    /*!
+         \brief Сколько байт записей незарегистрированных типов пропущено перед текущей
+     */
+    uint64_t skippedSize() const { return currentSkipped; }
+    /*!
+         \brief Параметры текущей фигуры. Могут указывать прямо в память источника
+                и действительны до следующего read() или, при заданной арене, до ее reset()
+     */
+    Utils::Span<const double> params() const { return currentView; }
+    bool isValid() const
+    {
+        return !!currentFigure;
+    }
+
+    /*!
+         \brief Диапазон записей источника для последовательного обхода.
+                Каждая запись читается в один и тот же объект Feature, поэтому
+                память не растет с количеством записей
+     */
+    class Records
+    {
+        Feature &feature;
+        const Reader::IReader &reader;
+
+    public:
+        class iterator
+        {
+            Feature *feature = nullptr;
+            const Reader::IReader *reader = nullptr;
+
+            void next()
+            {
+                if (!feature->read(*reader))
+                    feature = nullptr;
+            }
+
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = Feature;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Feature*;
+            using reference = const Feature&;
+
+            iterator() = default;
+            iterator(Feature &feature_, const Reader::IReader &reader_)
+            : feature(&feature_),
+              reader(&reader_)
+            {
+                next();
+            }
+            reference operator*() const { return *feature; }
+            pointer operator->() const { return feature; }
+            iterator &operator++()
+            {
+                next();
+                return *this;
+            }
+            bool operator==(const iterator &other) const { return feature == other.feature; }
+            bool operator!=(const iterator &other) const { return feature != other.feature; }
+        };
+
+        Records(Feature &feature_, const Reader::IReader &reader_)
+        : feature(feature_),
+          reader(reader_)
+        {
+        }
+        iterator begin() { return iterator(feature, reader); }
+        iterator end() { return iterator(); }
+    };
+
+    /*!
+         \brief Обход всех записей источника до конца данных или первой ошибки
+     */
+    Records records(const Reader::IReader &reader)
+    {
+        return Records(*this, reader);
+    }
+};
+
+/*!
+     \brief Чтение записей набора фигур FigureEngine (Figure::Engine<...>) в типизированные
+            записи Figure::Record. Размер параметров каждого типа известен на этапе компиляции,
+            поэтому они читаются одним блоком прямо в std::array записи, без буферов и проверок размера.
+            Фигуры вне набора, зарегистрированные в фабрике, читаются в Figure::AnyRecord
+ */
+template <typename FigureEngine>
+class TypedFeature
+{
+    Format::Format dataFormat;
+    const Figure::Factory *figureFactory;
+    typename FigureEngine::RecordVariant currentRecord;
+    bool valid = false;
+    mutable std::vector<double> anyParams;      ///< параметры текущей Figure::AnyRecord
+    mutable std::vector<uint8_t> anyEncoded;
+
+    template <typename FigureImpl>
+    bool readParams(const Reader::IReader &reader, Figure::Record<FigureImpl> &record) const
+    {
+        constexpr size_t COUNT_PARAMS = FigureImpl::COUNT_PARAMS;
+        if (dataFormat.isRaw())
+        {
+            // копирование блока известного размера разворачивается компилятором в несколько пересылок
+            if (const void *data = reader.view(sizeof(double), COUNT_PARAMS))
+            {
+                memcpy(record.params.data(), data, sizeof(record.params));
+                return true;
+            }
+            return reader.read(record.params.data(), sizeof(double), COUNT_PARAMS);
+        }
+
+        uint8_t encoded[COUNT_PARAMS * sizeof(double)];
+        const void *data = reader.view(dataFormat.paramSize(), COUNT_PARAMS);
+        if (!data)
+        {
+            if (!reader.read(encoded, dataFormat.paramSize(), COUNT_PARAMS))
+                return false;
+            data = encoded;
+        }
+        dataFormat.decode(data, COUNT_PARAMS, FigureImpl::LENGTH_PARAMS, record.params.data());
+        return true;
+    }
+    template <typename OnRecord>
+    bool readAny(const Reader::IReader &reader, const Figure::Figure &figure, uint32_t length, OnRecord &onRecord) const
+    {
+        size_t countParams = 0;
+        if (!dataFormat.countParams(figure.countParams(), length, countParams))
+            return false;
+        anyParams.resize(countParams);
+        const size_t paramSize = dataFormat.paramSize();
+        if (dataFormat.isRaw())
+        {
+            if (!reader.read(anyParams.data(), sizeof(double), countParams))
+                return false;
+        }
+        else
+        {
+            const void *data = reader.view(paramSize, countParams);
+            if (!data)
+            {
+                anyEncoded.resize(paramSize * countParams);
+                if (!reader.read(anyEncoded.data(), paramSize, countParams))
+                    return false;
+                data = anyEncoded.data();
+            }
+            dataFormat.decode(data, countParams, figure.lengthParams(), anyParams.data());
+        }
+        if (!skipExtra(reader, countParams, length))
+            return false;
+
+        Figure::AnyRecord record;
+        record.figure = &figure;
+        record.params = Utils::Span<const double>(anyParams.data(), countParams);
+        onRecord(static_cast<const Figure::AnyRecord&>(record));
+        return true;
+    }
+    template <typename OnRecord>
+    bool readPrefixed(const Reader::IReader &reader, OnRecord &onRecord) const
+    {
+        while (true)
+        {
+            Figure::Type type;
+            uint32_t length = 0;
+            if (!reader.read(&type, sizeof(type)))
+                return false;
+            bool res = reader.read(&length, sizeof(length));
+            const bool inEngine = res && FigureEngine::visit(type, [&](auto tag)
+            {
+                using FigureImpl = typename decltype(tag)::type;
+                Figure::Record<FigureImpl> record;
+                res = length >= FigureImpl::COUNT_PARAMS * dataFormat.paramSize()
+                    && readParams(reader, record) && skipExtra(reader, FigureImpl::COUNT_PARAMS, length);
+                if (res)
+                    onRecord(static_cast<const decltype(record)&>(record));
+            });
+            if (res && !inEngine)
+            {
+                if (const Figure::Figure *figure = figureFactory ? figureFactory->prototype(type) : nullptr)
+                    res = readAny(reader, *figure, length, onRecord);
+                else if (Reader::skip(reader, length))
+                    continue;
+                else
+                    res = false;
+            }
+            if (!res)
+                PROSOFT_COUNT(eRecordsRejected, 1);
+            return res;
+        }
+    }
+    /*!
+         \brief Пропуск байт записи после параметров фигуры, если префикс длины их указывает
+     */
+    bool skipExtra(const Reader::IReader &reader, size_t countParams, uint32_t length) const
+    {
+        const size_t size = countParams * dataFormat.paramSize();
+        return !dataFormat.hasLengthPrefix() || length == size || Reader::skip(reader, length - size);
+    }
+
+public:
+    /*!
+         \param format - формат записей источника, по умолчанию исходный
+         \param factory - фабрика для фигур вне набора, nullptr - такие записи считаются незарегистрированными
+     */
+    explicit TypedFeature(const Format::Format &format = Format::Format(), const Figure::Factory *factory = nullptr)
+        : dataFormat(format),
+          figureFactory(factory)
+    {
+    }
+    /*!
+         \brief Чтение записи с передачей ее в onRecord(const Figure::Record<FigureImpl>&)
+                или onRecord(const Figure::AnyRecord&) для фигуры вне набора.
+                Тип записи разрешается на этапе компиляции для каждой ветви, запись не сохраняется.
+                Записи незарегистрированных типов в формате с префиксом длины пропускаются;
+                их учитывает в метриках тот, кто делит данные на записи, чтобы не считать дважды
+         \return false в конце данных, при ошибке чтения или незарегистрированном типе без префикса длины
+     */
+    template <typename OnRecord>
+    bool read(const Reader::IReader &reader, OnRecord &&onRecord) const
+    {
+        if (dataFormat.hasLengthPrefix())
+            return readPrefixed(reader, onRecord);
+
+        Figure::Type type;
+        if (!reader.read(&type, sizeof(type)))
+            return false;
+
+        bool res = false;
+        const bool inEngine = FigureEngine::visit(type, [&](auto tag)
+        {
+            Figure::Record<typename decltype(tag)::type> record;
+            res = readParams(reader, record);
+            if (res)
+                onRecord(static_cast<const decltype(record)&>(record));
+        });
+        if (!inEngine && figureFactory)
+            if (const Figure::Figure *figure = figureFactory->prototype(type))
+                res = readAny(reader, *figure, 0, onRecord);
+        if (!res)
+            PROSOFT_COUNT(eRecordsRejected, 1);
+        return res;
+    }
+    /*!
+         \brief Чтение записи в текущую, доступную через record()
+     */
+    bool read(const Reader::IReader &reader)
+    {
+        valid = read(reader, [this](const auto &record) { currentRecord = record; });
+        return valid;
+    }
+    const typename FigureEngine::RecordVariant &record() const { return currentRecord; }
+    bool isValid() const { return valid; }
+    void draw(const Drawer::IDrawer &drawer) const
+    {
+        if (!valid)
+            return;
+        PROSOFT_COUNT(eDrawCalls, 1);
+        PROSOFT_COUNT(eFiguresDrawn, 1);
+        std::visit([&drawer](const auto &record) { record.draw(drawer); }, currentRecord);
+    }
+};
+
+/*!
+     \brief Пакет декодированных записей, сгруппированных по типу фигуры.
+            Параметры каждого типа лежат в непрерывных колонках, поэтому
+            преобразования и отрисовка обходят память линейно.
+            Фигуры типов, зарегистрированных во время выполнения, хранятся в others.
+            Их рисуют, проверяет Validation, отсекает Culling и преобразует Transform::apply(),
+            а упрощение и пространственный индекс их не касаются, и Retained::Scene их не хранит
+ */
+class FeatureBatch
+{
+public:
+    /*!
+         \brief Колонки параметров кругов
+     */
+    struct Circles
+    {
+        std::vector<double> centerX;
+        std::vector<double> centerY;
+        std::vector<double> radius;
+        std::vector<uint64_t> ids;    ///< порядковые номера записей в источнике
+
+        size_t size() const { return ids.size(); }
+        void clear()
+        {
+            centerX.clear();
+            centerY.clear();
+            radius.clear();
+            ids.clear();
+        }
+    };
+
+    /*!
+         \brief Многоугольники с фиксированным числом вершин.
+                Вершины упакованы подряд: x0, y0, x1, y1, ...
+     */
+    struct Poligons
+    {
+        size_t countParams;
+        std::vector<double> points;
+        std::vector<uint32_t> offsets{0}; ///< начала многоугольников в points и конец последнего, для IDrawer::drawPoligons()
+        std::vector<uint64_t> ids;        ///< порядковые номера записей в источнике
+
+        explicit Poligons(size_t countParams_)
+        : countParams(countParams_)
+        {
+        }
+        size_t size() const { return ids.size(); }
+        Utils::Span<const double> poligon(size_t index) const
+        {
+            return Utils::Span<const double>(points.data() + index * countParams, countParams);
+        }
+        void clear()
+        {
+            points.clear();
+            offsets.resize(1);
+            ids.clear();
+        }
+    };
+
+    /*!
+         \brief Фигуры одного типа без своих колонок. Параметры записей лежат подряд,
+                как вершины Poligons, но их количество у записей может быть разным
+     */
+    struct Group
+    {
+        const Figure::Figure *figure = nullptr;
+        std::vector<double> params;
+        std::vector<uint32_t> offsets{0}; ///< начала записей в params и конец последней, для Figure::drawBatch()
+        std::vector<uint64_t> ids;        ///< порядковые номера записей в источнике
+
+        size_t size() const { return ids.size(); }
+        Utils::Span<const double> record(size_t index) const
+        {
+            return Utils::Span<const double>(params.data() + offsets[index], offsets[index + 1] - offsets[index]);
+        }
+        void clear()
+        {
+            params.clear();
+            offsets.resize(1);
+            ids.clear();
+        }
+    };
+
+    Circles circles;
+    Poligons triangles{Figure::Triangle::COUNT_PARAMS};
+    Poligons squares{Figure::Square::COUNT_PARAMS};
+    std::vector<Group> others;  ///< по группе на тип в порядке появления; clear() оставляет группы пустыми
+
+    /*!
+         \brief Отметки элементов пакета, по битовой карте на каждую группу
+     */
+    struct Selection
+    {
+        Utils::Bitmap circles;
+        Utils::Bitmap triangles;
+        Utils::Bitmap squares;
+        std::vector<Utils::Bitmap> others;  ///< по карте на группу others пакета; группы без карты отбором не затрагиваются
+
+        size_t count() const
+        {
+            size_t res = circles.count() + triangles.count() + squares.count();
+            for (const Utils::Bitmap &group : others)
+                res += group.count();
+            return res;
+        }
+    };
+
+    size_t size() const
+    {
+        size_t res = circles.size() + triangles.size() + squares.size();
+        for (const Group &group : others)
+            res += group.size();
+        return res;
+    }
+    bool empty() const { return !size(); }
+    void clear()
+    {
+        circles.clear();
+        triangles.clear();
+        squares.clear();
+        for (Group &group : others)
+            group.clear();
+    }
+    /*!
+         \brief Группа фигур типа type или nullptr, если ее нет. Пакет не меняется
+     */
+    const Group *findGroup(Figure::Type type) const
+    {
+        for (const Group &group : others)
+            if (group.figure->type() == type)
+                return &group;
+        return nullptr;
+    }
+    /*!
+         \brief Группа фигур типа figure, новая пустая, если ее еще нет
+     */
+    Group &group(const Figure::Figure &figure)
+    {
+        for (Group &group : others)
+            if (group.figure->type() == figure.type())
+                return group;
+        others.emplace_back();
+        others.back().figure = &figure;
+        return others.back();
+    }
+
+    /*!
+         \brief Удаление на месте всех элементов, не отмеченных в keep. Порядок оставшихся не меняется.
+                Группы others, для которых в keep нет карты, остаются целиком
+     */
+    void filter(const Selection &keep)
+    {
+        size_t dst = 0;
+        for (size_t i = 0; i < circles.size(); ++i)
+        {
+            if (!keep.circles.test(i))
+                continue;
+            circles.centerX[dst] = circles.centerX[i];
+            circles.centerY[dst] = circles.centerY[i];
+            circles.radius[dst] = circles.radius[i];
+            circles.ids[dst] = circles.ids[i];
+            ++dst;
+        }
+        circles.centerX.resize(dst);
+        circles.centerY.resize(dst);
+        circles.radius.resize(dst);
+        circles.ids.resize(dst);
+
+        filter(triangles, keep.triangles);
+        filter(squares, keep.squares);
+        for (size_t i = 0; i < std::min(others.size(), keep.others.size()); ++i)
+            filter(others[i], keep.others[i]);
+    }
+
+    /*!
+         \brief Добавление текущей записи Feature в пакет
+         \param id - порядковый номер записи в источнике
+     */
+    bool append(const Feature &feature, uint64_t id)
+    {
+        const Figure::Figure *figure = feature.figure();
+        if (!figure)
+            return false;
+
+        const Utils::Span<const double> params = feature.params();
+        switch (figure->type())
+        {
+        case Figure::eCircle:
+            if (params.size() < Figure::Circle::COUNT_PARAMS)
+                return false;
+            circles.centerX.push_back(params[0]);
+            circles.centerY.push_back(params[1]);
+            circles.radius.push_back(params[2]);
+            circles.ids.push_back(id);
+            return true;
+        case Figure::eTriangle:
+            return append(triangles, params, id);
+        case Figure::eSquare:
+            return append(squares, params, id);
+        default:
+            return append(group(*figure), params, id);
+        }
+    }
+
+    /*!
+         \brief Добавление типизированных записей. Размер параметров известен заранее и не проверяется
+     */
+    bool append(const Figure::Record<Figure::Circle> &record, uint64_t id)
+    {
+        circles.centerX.push_back(record.params[0]);
+        circles.centerY.push_back(record.params[1]);
+        circles.radius.push_back(record.params[2]);
+        circles.ids.push_back(id);
+        return true;
+    }
+    bool append(const Figure::Record<Figure::Triangle> &record, uint64_t id)
+    {
+        return append(triangles, record.params, id);
+    }
+    bool append(const Figure::Record<Figure::Square> &record, uint64_t id)
+    {
+        return append(squares, record.params, id);
+    }
+    bool append(const Figure::AnyRecord &record, uint64_t id)
+    {
+        return append(group(*record.figure), record.params, id);
+    }
+    /*!
+         \brief Фигуры, для которых в пакете нет колонок, не добавляются
+     */
+    template <typename FigureImpl>
+    bool append(const Figure::Record<FigureImpl> &, uint64_t)
+    {
+        return false;
+    }
+    template <typename FigureEngine>
+    bool append(const TypedFeature<FigureEngine> &feature, uint64_t id)
+    {
+        return feature.isValid()
+            && std::visit([this, id](const auto &record) { return append(record, id); }, feature.record());
+    }
+
+    /*!
+         \brief Добавление всех записей другого пакета в конец этого
+         \return false, если смещения какой-то группы вышли бы за uint32_t. Тогда пакет не меняется
+     */
+    bool append(const FeatureBatch &other)
+    {
+        if (!fits(triangles.points.size(), other.triangles.points.size())
+            || !fits(squares.points.size(), other.squares.points.size()))
+            return false;
+        for (const Group &source : other.others)
+        {
+            const Group *target = findGroup(source.figure->type());
+            if (!fits(target ? target->params.size() : 0, source.params.size()))
+                return false;
+        }
+
+        append(circles.centerX, other.circles.centerX);
+        append(circles.centerY, other.circles.centerY);
+        append(circles.radius, other.circles.radius);
+        append(circles.ids, other.circles.ids);
+        for (auto group : { std::make_pair(&triangles, &other.triangles), std::make_pair(&squares, &other.squares) })
+        {
+            const uint32_t base = group.first->offsets.back();
+            for (size_t i = 1; i < group.second->offsets.size(); ++i)
+                group.first->offsets.push_back(base + group.second->offsets[i]);
+            append(group.first->points, group.second->points);
+            append(group.first->ids, group.second->ids);
+        }
+        for (const Group &source : other.others)
+        {
+            Group &target = group(*source.figure);
+            const uint32_t base = target.offsets.back();
+            for (size_t i = 1; i < source.offsets.size(); ++i)
+                target.offsets.push_back(base + source.offsets[i]);
+            append(target.params, source.params);
+            append(target.ids, source.ids);
+        }
+        return true;
+    }
+    /*!
+         \brief Добавление отмеченных в keep записей другого пакета в конец этого. Порядок записей сохраняется.
+                Из групп others, для которых в keep нет карты, ничего не добавляется
+         \return false, если смещения какой-то группы вышли бы за uint32_t.
+                 Записи этой группы, которые еще помещались, добавляются
+     */
+    bool append(const FeatureBatch &other, const Selection &keep)
+    {
+        keep.circles.forEach([this, &other](size_t i)
+        {
+            circles.centerX.push_back(other.circles.centerX[i]);
+            circles.centerY.push_back(other.circles.centerY[i]);
+            circles.radius.push_back(other.circles.radius[i]);
+            circles.ids.push_back(other.circles.ids[i]);
+        });
+        bool res = append(triangles, other.triangles, keep.triangles);
+        res = append(squares, other.squares, keep.squares) && res;
+        for (size_t i = 0; i < std::min(other.others.size(), keep.others.size()); ++i)
+        {
+            const Group &source = other.others[i];
+            Group &target = group(*source.figure);
+            keep.others[i].forEach([&res, &target, &source](size_t k)
+            {
+                res = append(target, source.record(k), source.ids[k]) && res;
+            });
+        }
+        return res;
+    }
+
+    /*!
+         \brief Чтение до maxRecords записей источника в пакет
+         \param firstId - порядковый номер первой читаемой записи
+         \return количество прочитанных записей
+     */
+    size_t read(Feature &feature, const Reader::IReader &reader, size_t maxRecords, uint64_t firstId = 0)
+    {
+        const GroupSizes before = groupSizes();
+        size_t count = 0;
+        while (count < maxRecords && feature.read(reader) && append(feature, firstId + count))
+            ++count;
+        countDecoded(before);
+        return count;
+    }
+    /*!
+         \brief Чтение типизированных записей: каждая запись попадает в свою колонку
+                без промежуточного хранения и проверок размера
+     */
+    template <typename FigureEngine>
+    size_t read(const TypedFeature<FigureEngine> &feature, const Reader::IReader &reader, size_t maxRecords, uint64_t firstId = 0)
+    {
+        const GroupSizes before = groupSizes();
+        size_t count = 0;
+        bool appended = true;
+        auto onRecord = [&](const auto &record) { appended = append(record, firstId + count); };
+        while (count < maxRecords && feature.read(reader, onRecord) && appended)
+            ++count;
+        countDecoded(before);
+        return count;
+    }
+
+    /*!
+         \brief Отрисовка пакета: по одному пакетному вызову IDrawer на каждый непустой тип.
+                Порядок отрисовки внутри пакета - по типам, а не по номерам записей
+     */
+    void draw(const Drawer::IDrawer &drawer) const
+    {
+        if (circles.size())
+        {
+            PROSOFT_COUNT(eDrawCalls, 1);
+            drawer.drawCircles(circles.centerX, circles.centerY, circles.radius);
+        }
+        for (const Poligons *group : { &triangles, &squares })
+        {
+            if (group->size())
+            {
+                PROSOFT_COUNT(eDrawCalls, 1);
+                drawer.drawPoligons(group->points, group->offsets);
+            }
+        }
+        drawOthers(drawer);
+        PROSOFT_COUNT(eFiguresDrawn, size());
+    }
+    /*!
+         \brief Отрисовка кусками задачами пула, если drawer.isThreadSafe(), иначе как draw(drawer).
+                Порядок отрисовки фигур пакета при этом не определен. Фигуры others
+                рисует вызывающий поток
+     */
+    void draw(const Drawer::IDrawer &drawer, Scheduler::Pool &pool) const
+    {
+        static const size_t MIN_PIECE = 256;
+        const size_t concurrency = pool.concurrency();
+        if (!drawer.isThreadSafe() || concurrency <= 1 || size() < 2 * MIN_PIECE)
+            return draw(drawer);
+
+        struct Piece
+        {
+            const Poligons *group;  ///< nullptr для кругов
+            size_t first;
+            size_t count;
+        };
+        drawOthers(drawer);
+        const size_t pieceSize = std::max((size() + concurrency - 1) / concurrency, MIN_PIECE);
+        std::vector<Piece> pieces;
+        for (size_t i = 0; i < circles.size(); i += pieceSize)
+            pieces.push_back({ nullptr, i, std::min(pieceSize, circles.size() - i) });
+        for (const Poligons *group : { &triangles, &squares })
+            for (size_t i = 0; i < group->size(); i += pieceSize)
+                pieces.push_back({ group, i, std::min(pieceSize, group->size() - i) });
+
+        Scheduler::parallelFor(pieces.size(), [&](size_t i)
+        {
+            const Piece &piece = pieces[i];
+            PROSOFT_COUNT(eDrawCalls, 1);
+            if (!piece.group)
+            {
+                drawer.drawCircles(Utils::Span<const double>(circles.centerX.data() + piece.first, piece.count),
+                                   Utils::Span<const double>(circles.centerY.data() + piece.first, piece.count),
+                                   Utils::Span<const double>(circles.radius.data() + piece.first, piece.count));
+                return;
+            }
+            // смещения абсолютные, так что кусок смещений работает с колонкой точек целиком
+            drawer.drawPoligons(piece.group->points, Utils::Span<const uint32_t>(piece.group->offsets.data() + piece.first, piece.count + 1));
+        }, 0, pool);
+        PROSOFT_COUNT(eFiguresDrawn, size());
+    }
+    /*!
+         \brief Отрисовка только фигур others, по вызову Figure::drawBatch() на группу
+     */
+    void drawOthers(const Drawer::IDrawer &drawer) const
+    {
+        for (const Group &group : others)
+        {
+            if (group.size())
+            {
+                PROSOFT_COUNT(eDrawCalls, 1);
+                group.figure->drawBatch(drawer, group.params, group.offsets);
+            }
+        }
+    }
+
+    /*!
+         \brief Смещения групп хранятся в uint32_t: count параметров можно дописать к size,
+                только если конец останется представимым
+     */
+    static bool fits(size_t size, size_t count)
+    {
+        return count <= std::numeric_limits<uint32_t>::max() - std::min<size_t>(size, std::numeric_limits<uint32_t>::max());
+    }
+
+private:
+    using GroupSizes = std::array<size_t, Figure::eCountTypes>;
+
+    GroupSizes groupSizes() const { return {{ circles.size(), triangles.size(), squares.size() }}; }
+    /*!
+         \brief Учет декодированных записей по типам одним приращением на пакет
+     */
+    void countDecoded(const GroupSizes &before) const
+    {
+        const GroupSizes after = groupSizes();
+        for (size_t i = 0; i < after.size(); ++i)
+            PROSOFT_COUNT_RECORDS(static_cast<Figure::Type>(i), after[i] - before[i]);
+        (void)before;
+        (void)after;
+    }
+    static void filter(Poligons &group, const Utils::Bitmap &keep)
+    {
+        size_t dst = 0;
+        for (size_t i = 0; i < group.size(); ++i)
+        {
+            if (!keep.test(i))
+                continue;
+            if (dst != i)
+            {
+                std::copy_n(group.points.begin() + i * group.countParams, group.countParams,
+                            group.points.begin() + dst * group.countParams);
+                group.ids[dst] = group.ids[i];
+            }
+            ++dst;
+        }
+        group.points.resize(dst * group.countParams);
+        group.ids.resize(dst);
+        group.offsets.resize(dst + 1);
+    }
+    static void filter(Group &group, const Utils::Bitmap &keep)
+    {
+        size_t dst = 0;
+        uint32_t end = 0;
+        for (size_t i = 0; i < group.size(); ++i)
+        {
+            if (!keep.test(i))
+                continue;
+            const uint32_t begin = group.offsets[i];
+            const uint32_t count = group.offsets[i + 1] - begin;
+            if (dst != i)
+            {
+                std::copy_n(group.params.begin() + begin, count, group.params.begin() + end);
+                group.ids[dst] = group.ids[i];
+            }
+            end += count;
+            group.offsets[++dst] = end;
+        }
+        group.params.resize(end);
+        group.ids.resize(dst);
+        group.offsets.resize(dst + 1);
+    }
+    static bool append(Poligons &group, Utils::Span<const double> params, uint64_t id)
+    {
+        if (params.size() < group.countParams || !fits(group.points.size(), group.countParams))
+            return false;
+        group.points.insert(group.points.end(), params.begin(), params.begin() + group.countParams);
+        group.offsets.push_back(static_cast<uint32_t>(group.points.size()));
+        group.ids.push_back(id);
+        return true;
+    }
+    /*!
+         \brief У фигуры с постоянным числом параметров лишние параметры отбрасываются
+     */
+    static bool append(Group &group, Utils::Span<const double> params, uint64_t id)
+    {
+        const size_t countParams = group.figure->isVariable() ? params.size() : group.figure->countParams();
+        if (params.size() < countParams || !fits(group.params.size(), countParams))
+            return false;
+        group.params.insert(group.params.end(), params.begin(), params.begin() + countParams);
+        group.offsets.push_back(static_cast<uint32_t>(group.params.size()));
+        group.ids.push_back(id);
+        return true;
+    }
+    static bool append(Poligons &group, const Poligons &other, const Utils::Bitmap &keep)
+    {
+        bool res = true;
+        keep.forEach([&res, &group, &other](size_t i)
+        {
+            res = res && append(group, other.poligon(i), other.ids[i]);
+        });
+        return res;
+    }
+    template <size_t N>
+    static bool append(Poligons &group, const std::array<double, N> &params, uint64_t id)
+    {
+        if (!fits(group.points.size(), N))
+            return false;
+        group.points.insert(group.points.end(), params.begin(), params.end());
+        group.offsets.push_back(static_cast<uint32_t>(group.points.size()));
+        group.ids.push_back(id);
+        return true;
+    }
+    template <typename T>
+    static void append(std::vector<T> &dst, const std::vector<T> &src)
+    {
+        dst.insert(dst.end(), src.begin(), src.end());
+    }
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "Feature.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Metrics.h"
+#include "Reader.h"
+#include "Scheduler.h"
+#include "Utils.h"
+#include "Validation.h"
+
+/*!
+     \brief Параллельное декодирование записей, целиком находящихся в памяти.
+            Быстрый проход по заголовкам записей делит данные на куски,
+            куски декодируются задачами общего пула в свои FeatureBatch,
+            которые затем сливаются в исходном порядке записей.
+            Данные передаются целиком вместе с заголовком формата, смещения записей
+            отсчитываются от начала данных
+ */
+class FeatureDecoder
+{
+    const Figure::Factory &figureFactory;
+    Format::Format dataFormat;
+    std::optional<Validation::Validator> validator{Validation::Validator()};
+
+    /*!
+         \brief Обход заголовков записей: onRecord(offset, recordSize, type) для каждой целой записи.
+                Записи незарегистрированных типов в формате с префиксом длины пропускаются
+         \return false, если встретился незарегистрированный тип без префикса длины или обрезанная запись
+     */
+    template <typename OnRecord>
+    bool walk(Utils::Span<const uint8_t> data, OnRecord &&onRecord) const
+    {
+        size_t offset = dataFormat.headerSize();
+        uint64_t countRecords = 0;
+        bool res = true;
+        while (offset < data.size())
+        {
+            Figure::Type type;
+            uint32_t length = 0;
+            if (data.size() - offset < dataFormat.prefixSize())
+            {
+                res = false;
+                break;
+            }
+            memcpy(&type, data.data() + offset, sizeof(type));
+            if (dataFormat.hasLengthPrefix())
+                memcpy(&length, data.data() + offset + sizeof(type), sizeof(length));
+
+            const Figure::Figure *figure = figureFactory.prototype(type);
+            size_t countParams = 0;
+            if (!figure)
+            {
+                PROSOFT_COUNT(ePrototypeMisses, 1);
+                if (dataFormat.hasLengthPrefix() && data.size() - offset - dataFormat.prefixSize() >= length)
+                {
+                    PROSOFT_COUNT(eRecordsSkipped, 1);
+                    offset += dataFormat.prefixSize() + length;
+                    continue;
+                }
+                res = false;
+                break;
+            }
+            if (!dataFormat.countParams(figure->countParams(), length, countParams))
+            {
+                res = false;
+                break;
+            }
+
+            const size_t recordSize = dataFormat.hasLengthPrefix() ? dataFormat.prefixSize() + length : dataFormat.recordSize(countParams);
+            if (data.size() - offset < recordSize)
+            {
+                res = false;
+                break;
+            }
+
+            onRecord(offset, recordSize, type);
+            offset += recordSize;
+            ++countRecords;
+        }
+        PROSOFT_COUNT(ePrototypeHits, countRecords);
+        if (!res)
+            PROSOFT_COUNT(eRecordsRejected, 1);
+        return res;
+    }
+
+    struct Chunk
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        uint64_t firstId = 0;
+        size_t countRecords = 0;
+        bool ok = true;
+        FeatureBatch batch;
+    };
+
+public:
+    /*!
+         \param format - формат данных, см. Format::detect()
+     */
+    explicit FeatureDecoder(const Figure::Factory &figureFactory, const Format::Format &format = Format::Format())
+        : figureFactory(figureFactory),
+          dataFormat(format)
+    {
+    }
+    const Format::Format &format() const { return dataFormat; }
+    /*!
+         \brief Проверка декодированных фигур, включена по умолчанию. Недопустимые фигуры
+                не попадают в результат и не прерывают декодирование
+     */
+    void setValidator(const Validation::Validator &value) { validator = value; }
+    void resetValidator() { validator.reset(); }
+
+    /*!
+         \brief Поиск смещений начала всех записей и, при необходимости, их типов
+         \return false, если данные содержат ошибку. Смещения записей до ошибки сохраняются
+     */
+    bool scan(Utils::Span<const uint8_t> data, std::vector<uint64_t> &offsets, std::vector<Figure::Type> *types = nullptr) const
+    {
+        return walk(data, [&offsets, types](size_t offset, size_t, Figure::Type type)
+        {
+            offsets.push_back(offset);
+            if (types)
+                types->push_back(type);
+        });
+    }
+
+    /*!
+         \brief Декодирование всех записей в batch
+         \param countThreads - количество кусков, декодируемых задачами Scheduler::Pool::shared(),
+                0 - по числу потоков пула
+         \return false, если данные содержат ошибку или не помещаются в один пакет:
+                 смещения многоугольников и групп others хранятся в uint32_t.
+                 Записи до ошибки декодируются
+     */
+    bool decode(Utils::Span<const uint8_t> data, FeatureBatch &batch, size_t countThreads = 0) const
+    {
+        if (!countThreads)
+            countThreads = Scheduler::Pool::shared().concurrency();
+
+        // границы кусков - первые записи, начинающиеся не раньше равных долей данных
+        std::vector<Chunk> chunks(1);
+        chunks.front().begin = chunks.front().end = dataFormat.headerSize();
+        const size_t chunkSize = std::max<size_t>(data.size() / countThreads, 1);
+        uint64_t countRecords = 0;
+        const bool res = walk(data, [&](size_t offset, size_t recordSize, Figure::Type)
+        {
+            if (offset >= chunks.back().begin + chunkSize && chunks.size() < countThreads)
+            {
+                chunks.emplace_back();
+                chunks.back().begin = offset;
+                chunks.back().firstId = countRecords;
+            }
+            chunks.back().end = offset + recordSize;
+            ++chunks.back().countRecords;
+            ++countRecords;
+        });
+
+        auto decodeChunk = [this, &data](Chunk &chunk)
+        {
+            PROSOFT_TIME_SCOPE(eDecode);
+            Reader::Memory reader(data.subspan(chunk.begin, chunk.end - chunk.begin));
+            const TypedFeature<Figure::Figures> feature(dataFormat, &figureFactory);
+            chunk.ok = chunk.batch.read(feature, reader, SIZE_MAX, chunk.firstId) == chunk.countRecords;
+            if (validator)
+            {
+                PROSOFT_TIME_SCOPE(eValidate);
+                validator->validate(chunk.batch);
+            }
+        };
+
+        Scheduler::parallelFor(chunks.size(), [&](size_t i) { decodeChunk(chunks[i]); });
+
+        for (const Chunk &chunk : chunks)
+            if (!batch.append(chunk.batch) || !chunk.ok)
+                return false;
+        return res;
+    }
+};
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Feature.h"
+#include "FeatureDecoder.h"
+#include "Figure.h"
+#include "Reader.h"
+#include "Utils.h"
+
+/*!
+     \brief Индекс записей для произвольного доступа: смещение и тип каждой записи
+            и списки номеров записей по встроенным типам. Сохраняется в файл рядом с данными
+ */
+class FeatureIndex
+{
+    std::vector<uint64_t> offsets;
+    std::vector<Figure::Type> types;
+    std::array<std::vector<uint64_t>, Figure::eCountTypes> typeRecords;
+    uint64_t dataSize = 0;
+
+    static constexpr char MAGIC[4] = { 'P', 'S', 'I', 'X' };
+    static constexpr uint32_t VERSION = 1;
+
+    void partition()
+    {
+        for (auto &records : typeRecords)
+            records.clear();
+        for (uint64_t i = 0; i < types.size(); ++i)
+            if (types[i] >= 0 && types[i] < Figure::eCountTypes)
+                typeRecords[types[i]].push_back(i);
+    }
+
+public:
+    /*!
+         \brief Имя файла индекса для файла данных
+     */
+    static std::string filename(const std::string &dataFilename) { return dataFilename + ".idx"; }
+
+    /*!
+         \brief Построение индекса по данным в памяти
+         \return false, если данные содержат ошибку. Индексируются записи до ошибки
+     */
+    bool build(const FeatureDecoder &decoder, Utils::Span<const uint8_t> data)
+    {
+        offsets.clear();
+        types.clear();
+        const bool res = decoder.scan(data, offsets, &types);
+        dataSize = offsets.empty() ? 0 : data.size();
+        partition();
+        return res;
+    }
+    /*!
+         \brief Построение индекса последовательным чтением источника с первой записи
+         \return false, если чтение остановилось на испорченной записи, а не в конце данных.
+                 Индексируются записи до ошибки
+     */
+    bool build(Feature &feature, const Reader::IReader &reader)
+    {
+        offsets.clear();
+        types.clear();
+        uint64_t offset = feature.format().headerSize();
+        while (feature.read(reader))
+        {
+            offset += feature.skippedSize();
+            offsets.push_back(offset);
+            types.push_back(feature.figure()->type());
+            offset += feature.recordSize();
+        }
+        dataSize = offset;
+        partition();
+        return feature.isEnd();
+    }
+
+    bool save(const std::string &filename) const
+    {
+        std::unique_ptr<FILE, std::function<void(FILE*)>> file(::fopen(filename.c_str(), "wb"), [](FILE* f) { ::fclose(f); });
+        if (!file)
+            return false;
+
+        auto write = [&file](const void *src, size_t size, size_t count = 1)
+        {
+            return ::fwrite(src, size, count, file.get()) == count;
+        };
+        const uint64_t countRecords = offsets.size();
+        const uint32_t countTypes = Figure::eCountTypes;
+        bool res = write(MAGIC, sizeof(MAGIC)) && write(&VERSION, sizeof(VERSION))
+                && write(&countRecords, sizeof(countRecords)) && write(&dataSize, sizeof(dataSize))
+                && write(offsets.data(), sizeof(uint64_t), offsets.size())
+                && write(types.data(), sizeof(Figure::Type), types.size())
+                && write(&countTypes, sizeof(countTypes));
+        for (const auto &records : typeRecords)
+        {
+            const uint64_t count = records.size();
+            res = res && write(&count, sizeof(count)) && write(records.data(), sizeof(uint64_t), records.size());
+        }
+        return res;
+    }
+    /*!
+         \param expectedDataSize - размер файла данных для проверки актуальности индекса, 0 - не проверять
+     */
+    bool load(const std::string &filename, uint64_t expectedDataSize = 0)
+    {
+        Reader::File file(filename);
+        char magic[sizeof(MAGIC)];
+        uint32_t version = 0;
+        uint64_t countRecords = 0;
+        uint64_t size = 0;
+        if (!file.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+            || !file.read(&version, sizeof(version)) || version != VERSION
+            || !file.read(&countRecords, sizeof(countRecords)) || !file.read(&size, sizeof(size)))
+            return false;
+        if (expectedDataSize && size != expectedDataSize)
+            return false;
+        // количество записей из испорченного заголовка не должно приводить к огромному выделению
+        std::error_code error;
+        const uint64_t fileSize = std::filesystem::file_size(filename, error);
+        if (error || countRecords > fileSize / (sizeof(uint64_t) + sizeof(Figure::Type)))
+            return false;
+
+        std::vector<uint64_t> newOffsets(countRecords);
+        std::vector<Figure::Type> newTypes(countRecords);
+        uint32_t countTypes = 0;
+        if (!file.read(newOffsets.data(), sizeof(uint64_t), countRecords)
+            || !file.read(newTypes.data(), sizeof(Figure::Type), countRecords)
+            || !file.read(&countTypes, sizeof(countTypes)) || countTypes != Figure::eCountTypes)
+            return false;
+        for (Figure::Type type : newTypes)
+            if (type < 0 || static_cast<size_t>(type) >= Figure::Factory::MAX_TYPES)
+                return false;
+
+        std::array<std::vector<uint64_t>, Figure::eCountTypes> newTypeRecords;
+        for (auto &records : newTypeRecords)
+        {
+            uint64_t count = 0;
+            if (!file.read(&count, sizeof(count)) || count > countRecords)
+                return false;
+            records.resize(count);
+            if (!file.read(records.data(), sizeof(uint64_t), count))
+                return false;
+            for (uint64_t record : records)
+                if (record >= countRecords)
+                    return false;
+        }
+
+        offsets = std::move(newOffsets);
+        types = std::move(newTypes);
+        typeRecords = std::move(newTypeRecords);
+        dataSize = size;
+        return true;
+    }
+
+    size_t size() const { return offsets.size(); }
+    uint64_t offset(uint64_t record) const { return offsets[record]; }
+    Figure::Type type(uint64_t record) const { return types[record]; }
+    /*!
+         \brief Номера записей заданного встроенного типа по возрастанию, пустой список для остальных типов
+     */
+    const std::vector<uint64_t> &records(Figure::Type type) const
+    {
+        static const std::vector<uint64_t> NONE;
+        return type >= 0 && type < Figure::eCountTypes ? typeRecords[type] : NONE;
+    }
+
+    /*!
+         \brief Переход источника к началу записи record
+     */
+    bool seek(const Reader::IReader &reader, uint64_t record) const
+    {
+        return record < offsets.size() && reader.seek(offsets[record]);
+    }
+    /*!
+         \brief Чтение записей [first, first + count) в batch
+         \return количество прочитанных записей
+     */
+    size_t read(Feature &feature, const Reader::IReader &reader, uint64_t first, size_t count, FeatureBatch &batch) const
+    {
+        if (!seek(reader, first))
+            return 0;
+        count = static_cast<size_t>(std::min<uint64_t>(count, offsets.size() - first));
+        return batch.read(feature, reader, count, first);
+    }
+    /*!
+         \brief Чтение только записей типа type в batch
+         \return количество прочитанных записей
+     */
+    size_t read(Feature &feature, const Reader::IReader &reader, Figure::Type type, FeatureBatch &batch) const
+    {
+        if (type < 0 || type >= Figure::eCountTypes)
+            return 0;
+
+        size_t count = 0;
+        for (uint64_t record : typeRecords[type])
+        {
+            if (!seek(reader, record) || !feature.read(reader) || !batch.append(feature, record))
+                break;
+            ++count;
+        }
+        return count;
+    }
+};
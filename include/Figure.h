@@ -0,0 +1,313 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <variant>
+
+#include "Drawer.h"
+#include "Utils.h"
+
+namespace Figure
+{
+    /*!
+         \brief Типы фигур. Встроенные типы имеют свои колонки в FeatureBatch,
+                остальные регистрируются в Factory во время выполнения с номерами до Factory::MAX_TYPES
+     */
+    enum Type : int32_t
+    {
+        eCircle,
+        eTriangle,
+        eSquare,
+
+        eCountTypes     ///< количество встроенных типов, не является типом фигуры
+    };
+
+    /*!
+         \brief Базовый класс фигуры. Количество параметров 0 означает, что оно у каждой записи свое
+                и берется из префикса длины записи, см. Format::Format::eLengthPrefix
+     */
+    class Figure
+    {
+        Type _type;
+        size_t _countParams;
+        uint32_t _lengthParams;
+
+    public:
+        Figure(Type type_, size_t countParams_, uint32_t lengthParams_ = 0)
+        : _type(type_),
+          _countParams(countParams_),
+          _lengthParams(lengthParams_)
+        {
+        }
+        virtual ~Figure() = default;
+        Type type() const { return _type; };
+        size_t countParams() const { return _countParams; }
+        /*!
+             \brief Битовая маска параметров-длин (радиусов), остальные параметры - координаты x, y попеременно.
+                    Длины не сдвигаются на начало координат тайла в компактном формате
+         */
+        uint32_t lengthParams() const { return _lengthParams; }
+
+        bool isVariable() const { return !_countParams; }
+
+        virtual void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const = 0;
+        /*!
+             \brief Пакетная отрисовка фигур этого типа: фигура i занимает params[offsets[i], offsets[i + 1]),
+                    как в IDrawer::drawPoligons(). По умолчанию сводится к поштучным вызовам draw()
+         */
+        virtual void drawBatch(const Drawer::IDrawer &drawer, Utils::Span<const double> params, Utils::Span<const uint32_t> offsets) const
+        {
+            for (size_t i = 0; i + 1 < offsets.size(); ++i)
+                draw(drawer, params.subspan(offsets[i], offsets[i + 1] - offsets[i]));
+        }
+    };
+
+    /*!
+         \brief Реализация фигуры круг
+     */
+    class Circle : public Figure
+    {
+    public:
+        Circle() : Figure(TYPE, COUNT_PARAMS, LENGTH_PARAMS) {}
+        virtual ~Circle() = default;
+        void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const override
+        {
+            drawParams(drawer, params);
+        }
+        static void drawParams(const Drawer::IDrawer &drawer, Utils::Span<const double> params)
+        {
+            if (params.size() >= COUNT_PARAMS)
+                drawer.drawCircle(params[0], params[1], params[2]);
+        }
+        static const Type TYPE = eCircle;
+        static const size_t COUNT_PARAMS = 3;
+        static const uint32_t LENGTH_PARAMS = 1 << 2;  ///< радиус
+        using Params = std::array<double, COUNT_PARAMS>;
+
+        /*!
+             \brief Отрисовка параметров фиксированного размера, без проверки размера
+         */
+        static void drawParams(const Drawer::IDrawer &drawer, const Params &params)
+        {
+            drawer.drawCircle(params[0], params[1], params[2]);
+        }
+    };
+
+    /*!
+         \brief Реализация фигуры треугольник
+     */
+    class Triangle : public Figure
+    {
+    public:
+        Triangle() : Figure(TYPE, COUNT_PARAMS, LENGTH_PARAMS) {}
+        virtual ~Triangle() = default;
+        void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const override
+        {
+            drawParams(drawer, params);
+        }
+        static void drawParams(const Drawer::IDrawer &drawer, Utils::Span<const double> params)
+        {
+            if (params.size() >= COUNT_PARAMS)
+                drawer.drawPoligon(params);
+        }
+        static const Type TYPE = eTriangle;
+        static const size_t COUNT_PARAMS = 6;
+        static const uint32_t LENGTH_PARAMS = 0;
+        using Params = std::array<double, COUNT_PARAMS>;
+
+        static void drawParams(const Drawer::IDrawer &drawer, const Params &params)
+        {
+            drawer.drawPoligon(Utils::Span<const double>(params.data(), params.size()));
+        }
+    };
+
+    /*!
+         \brief Реализация фигуры квадрат
+     */
+    class Square : public Figure
+    {
+    public:
+        Square() : Figure(TYPE, COUNT_PARAMS, LENGTH_PARAMS) {}
+        virtual ~Square() = default;
+        void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const override
+        {
+            drawParams(drawer, params);
+        }
+        static void drawParams(const Drawer::IDrawer &drawer, Utils::Span<const double> params)
+        {
+            if (params.size() >= COUNT_PARAMS)
+                drawer.drawPoligon(params);
+        }
+        static const Type TYPE = eSquare;
+        static const size_t COUNT_PARAMS = 8;
+        static const uint32_t LENGTH_PARAMS = 0;
+        using Params = std::array<double, COUNT_PARAMS>;
+
+        static void drawParams(const Drawer::IDrawer &drawer, const Params &params)
+        {
+            drawer.drawPoligon(Utils::Span<const double>(params.data(), params.size()));
+        }
+    };
+
+    /*!
+         \brief Запись фигуры с параметрами фиксированного размера, известного на этапе компиляции
+     */
+    template <typename FigureImpl>
+    struct Record
+    {
+        using type = FigureImpl;
+        static const Type TYPE = FigureImpl::TYPE;
+
+        typename FigureImpl::Params params;
+
+        void draw(const Drawer::IDrawer &drawer) const { FigureImpl::drawParams(drawer, params); }
+    };
+
+    /*!
+         \brief Запись фигуры, зарегистрированной только в фабрике: параметры произвольного размера.
+                Параметры принадлежат читателю и действительны до следующего чтения
+     */
+    struct AnyRecord
+    {
+        const Figure *figure = nullptr;
+        Utils::Span<const double> params;
+
+        void draw(const Drawer::IDrawer &drawer) const { figure->draw(drawer, params); }
+    };
+
+    /*!
+         \brief Фабрика для генерации объектов фигур.
+                Фигуры не имеют состояния, поэтому кроме создания новых объектов
+                фабрика отдает общие экземпляры-прототипы из плотной таблицы по типу.
+                В таблице есть место под все типы до MAX_TYPES, поэтому поиск любого типа,
+                в том числе зарегистрированного во время выполнения, - одно сравнение с константой
+                и одно обращение по индексу
+     */
+    class Factory
+    {
+    public:
+        /*!
+             \brief Граница номеров типов: таблица плотная, 16 байт на тип
+         */
+        static constexpr size_t MAX_TYPES = 256;
+
+    private:
+        struct Entry
+        {
+            const Figure *prototype = nullptr;
+            Figure *(*create)() = nullptr;
+        };
+        std::array<Entry, MAX_TYPES> figureFactory;
+
+        template <typename FigureImpl>
+        static const Figure *instance()
+        {
+            static const FigureImpl figure;
+            return &figure;
+        }
+        template <typename FigureImpl>
+        void registerFigure(bool &res)
+        {
+            static_assert(FigureImpl::TYPE >= 0 && FigureImpl::TYPE < MAX_TYPES, "Unknown figure type");
+            Entry &entry = figureFactory[FigureImpl::TYPE];
+            if (entry.create)
+            {
+                res = false;
+                return;
+            }
+            entry.create = []() -> Figure* { return new FigureImpl(); };
+            entry.prototype = instance<FigureImpl>();
+        }
+        const Entry *find(Type type) const
+        {
+            // отрицательный тип после преобразования больше размера таблицы
+            if (static_cast<uint32_t>(type) >= MAX_TYPES)
+                return nullptr;
+            return &figureFactory[type];
+        }
+    public:
+        virtual ~Factory() = default;
+        template <typename... Args>
+        bool registerFigure()
+        {
+            bool res = true;
+            int dummy[] = { 0, (registerFigure<Args>(res), 0)... };
+            (void)dummy;
+            return res;
+        }
+        Figure* createFigure(Type type) const
+        {
+            const Entry *entry = find(type);
+            if (!entry || !entry->create)
+            {
+                return nullptr;
+            }
+            return entry->create();
+        }
+        /*!
+             \brief Общий экземпляр фигуры без выделения памяти. Владеет им фабрика
+             \return nullptr, если тип не зарегистрирован
+         */
+        const Figure *prototype(Type type) const
+        {
+            const Entry *entry = find(type);
+            return entry ? entry->prototype : nullptr;
+        }
+    };
+
+    /*!
+         \brief Статическая диспетчеризация по набору фигур, известному на этапе компиляции.
+                Набор задается один раз и из него же регистрируются фигуры в фабрике,
+                а выбор реализации по типу сводится к сравнению констант без виртуальных вызовов
+     */
+    template <typename... Figures>
+    class Engine
+    {
+    public:
+        /*!
+             \brief Метка типа фигуры, передаваемая в visitor
+         */
+        template <typename FigureImpl>
+        struct Tag
+        {
+            using type = FigureImpl;
+        };
+        /*!
+             \brief Типизированная запись любой фигуры набора или фигуры вне набора, известной фабрике
+         */
+        using RecordVariant = std::variant<Record<Figures>..., AnyRecord>;
+
+        static bool registerFigures(Factory &factory)
+        {
+            return factory.registerFigure<Figures...>();
+        }
+        /*!
+             \brief Вызов visitor(Tag<FigureImpl>()) для фигуры с типом type
+             \return false, если тип не входит в набор
+         */
+        template <typename Visitor>
+        static bool visit(Type type, Visitor &&visitor)
+        {
+            return ((type == Figures::TYPE && (visitor(Tag<Figures>()), true)) || ...);
+        }
+        static bool contains(Type type)
+        {
+            return ((type == Figures::TYPE) || ...);
+        }
+        static size_t countParams(Type type)
+        {
+            size_t res = 0;
+            visit(type, [&res](auto tag) { res = decltype(tag)::type::COUNT_PARAMS; });
+            return res;
+        }
+        static bool draw(Type type, const Drawer::IDrawer &drawer, Utils::Span<const double> params)
+        {
+            return visit(type, [&](auto tag) { decltype(tag)::type::drawParams(drawer, params); });
+        }
+    };
+
+    /*!
+         \brief Набор встроенных фигур
+     */
+    using Figures = Engine<Circle, Triangle, Square>;
+}
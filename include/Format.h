@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "Figure.h"
+#include "Reader.h"
+#include "Utils.h"
+
+namespace Format
+{
+    /*!
+         \brief Представление параметров фигур на диске
+     */
+    enum Encoding : uint32_t
+    {
+        eFloat64,   ///< double, как в исходном формате без заголовка
+        eFloat32,   ///< float относительно начала координат тайла
+        eInt32,     ///< фиксированная точка: origin + scale * int32
+        eInt16,     ///< фиксированная точка: origin + scale * int16
+
+        eCountEncodings ///< количество представлений, не является представлением
+    };
+
+    /*!
+         \brief Формат записей данных.
+                Исходный формат - записи Figure::Type и double[countParams] без заголовка.
+                Версионный формат начинается с заголовка:
+                    char magic[4] "PSFT", uint32 version, uint32 encoding, uint32 flags,
+                    double originX, double originY, double scale
+                после которого идут записи Figure::Type и параметры в представлении encoding.
+                С флагом eLengthPrefix за типом записи идет uint32 - длина параметров в байтах,
+                так что запись незарегистрированного типа можно пропустить, а у фигуры
+                с переменным числом параметров оно определяется длиной.
+                Координата восстанавливается как origin + scale * значение, длина - как scale * значение
+     */
+    class Format
+    {
+        template <typename T>
+        static T quantize(double value)
+        {
+            const double res = std::round(value);
+            if (!(res > std::numeric_limits<T>::min()))
+                return std::numeric_limits<T>::min();
+            if (!(res < std::numeric_limits<T>::max()))
+                return std::numeric_limits<T>::max();
+            return static_cast<T>(res);
+        }
+        /*!
+             \brief Начало отсчета параметра index: 0 для длин, originX или originY для координат
+         */
+        double origin(size_t index, uint32_t lengthParams) const
+        {
+            if (index < 32 && (lengthParams & (1u << index)))
+                return 0;
+            return index % 2 ? originY : originX;
+        }
+        template <typename T>
+        void decodeAs(const void *src, size_t countParams, uint32_t lengthParams, double *dst) const
+        {
+            for (size_t i = 0; i < countParams; ++i)
+            {
+                T value;
+                memcpy(&value, static_cast<const uint8_t*>(src) + i * sizeof(T), sizeof(T));
+                dst[i] = origin(i, lengthParams) + scale * value;
+            }
+        }
+
+    public:
+        /*!
+             \brief Флаги заголовка
+         */
+        enum Flags : uint32_t
+        {
+            eLengthPrefix = 1   ///< записи с префиксом длины параметров
+        };
+        static constexpr uint32_t KNOWN_FLAGS = eLengthPrefix;
+        static constexpr char MAGIC[4] = { 'P', 'S', 'F', 'T' };
+        static constexpr uint32_t VERSION = 1;
+        static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 3 * sizeof(uint32_t) + 3 * sizeof(double);
+        /*!
+             \brief Наибольшая длина параметров записи фигуры с переменным числом параметров.
+                    Длина из испорченного префикса не должна приводить к огромному выделению
+         */
+        static constexpr uint32_t MAX_VARIABLE_LENGTH = 1 << 24;
+
+        Encoding encoding = eFloat64;
+        double originX = 0;
+        double originY = 0;
+        double scale = 1;
+        bool header = false;    ///< есть ли заголовок, false - исходный формат
+        uint32_t flags = 0;     ///< Flags, только с заголовком
+
+        /*!
+             \brief Версионный формат с началом координат в центре bounds и шагом,
+                    при котором целые значения покрывают bounds. Значения за пределами
+                    диапазона представления прижимаются к его границам.
+                    Для eFloat64 начало координат не сдвигается, и параметры читаются без преобразования
+         */
+        static Format fit(Encoding encoding, const Utils::Rect &bounds)
+        {
+            Format res;
+            res.encoding = encoding;
+            res.header = true;
+            if (encoding == eFloat64)
+                return res;
+            res.originX = (bounds.minX + bounds.maxX) / 2;
+            res.originY = (bounds.minY + bounds.maxY) / 2;
+
+            const double half = std::max(bounds.width(), bounds.height()) / 2;
+            double maxValue = 0;
+            if (encoding == eInt32)
+                maxValue = std::numeric_limits<int32_t>::max();
+            else if (encoding == eInt16)
+                maxValue = std::numeric_limits<int16_t>::max();
+            if (maxValue && half > 0)
+                res.scale = half / maxValue;
+            return res;
+        }
+
+        size_t paramSize() const
+        {
+            switch (encoding)
+            {
+            case eFloat32:
+                return sizeof(float);
+            case eInt32:
+                return sizeof(int32_t);
+            case eInt16:
+                return sizeof(int16_t);
+            default:
+                return sizeof(double);
+            }
+        }
+        size_t headerSize() const { return header ? HEADER_SIZE : 0; }
+        bool hasLengthPrefix() const { return header && (flags & eLengthPrefix); }
+        /*!
+             \brief Размер типа и префикса длины: смещение параметров от начала записи
+         */
+        size_t prefixSize() const { return sizeof(Figure::Type) + (hasLengthPrefix() ? sizeof(uint32_t) : 0); }
+        size_t recordSize(size_t countParams) const { return prefixSize() + countParams * paramSize(); }
+        /*!
+             \brief Количество параметров записи фигуры
+             \param figureParams - Figure::countParams(), 0 - переменное
+             \param length - длина параметров из префикса, без префикса не используется
+             \return false, если длина меньше параметров фигуры или не кратна размеру параметра,
+                     или у фигуры переменное число параметров, а префикса нет, длина нулевая
+                     или больше MAX_VARIABLE_LENGTH.
+                     Запись без параметров не рисуется, а чтение нуля байт часть источников считает ошибкой,
+                     поэтому такую запись одинаково отвергают все читатели.
+                     Лишние байты после параметров фигуры - расширение записи, их пропускают
+         */
+        bool countParams(size_t figureParams, uint32_t length, size_t &res) const
+        {
+            res = figureParams;
+            if (!hasLengthPrefix())
+                return figureParams != 0;
+            if (figureParams)
+                return length >= figureParams * paramSize();
+            res = length / paramSize();
+            return length && length <= MAX_VARIABLE_LENGTH && length % paramSize() == 0;
+        }
+        /*!
+             \brief Параметры хранятся как есть и могут отдаваться без преобразования
+         */
+        bool isRaw() const { return encoding == eFloat64 && originX == 0 && originY == 0 && scale == 1; }
+
+        /*!
+             \brief Преобразование параметров фигуры в представление encoding
+             \param dst - буфер на countParams * paramSize() байт, выравнивание не требуется
+         */
+        void encode(const double *params, size_t countParams, uint32_t lengthParams, void *dst) const
+        {
+            uint8_t *out = static_cast<uint8_t*>(dst);
+            for (size_t i = 0; i < countParams; ++i)
+            {
+                const double value = (params[i] - origin(i, lengthParams)) / scale;
+                switch (encoding)
+                {
+                case eFloat32:
+                {
+                    const float res = static_cast<float>(value);
+                    memcpy(out + i * sizeof(res), &res, sizeof(res));
+                    break;
+                }
+                case eInt32:
+                {
+                    const int32_t res = quantize<int32_t>(value);
+                    memcpy(out + i * sizeof(res), &res, sizeof(res));
+                    break;
+                }
+                case eInt16:
+                {
+                    const int16_t res = quantize<int16_t>(value);
+                    memcpy(out + i * sizeof(res), &res, sizeof(res));
+                    break;
+                }
+                default:
+                {
+                    const double res = value;
+                    memcpy(out + i * sizeof(res), &res, sizeof(res));
+                    break;
+                }
+                }
+            }
+        }
+        /*!
+             \brief Запись целиком: тип, префикс длины, если он есть, и параметры
+             \param dst - буфер на recordSize(countParams) байт
+         */
+        void encodeRecord(Figure::Type type, const double *params, size_t countParams, uint32_t lengthParams, void *dst) const
+        {
+            uint8_t *out = static_cast<uint8_t*>(dst);
+            memcpy(out, &type, sizeof(type));
+            if (hasLengthPrefix())
+            {
+                const uint32_t length = static_cast<uint32_t>(countParams * paramSize());
+                memcpy(out + sizeof(type), &length, sizeof(length));
+            }
+            encode(params, countParams, lengthParams, out + prefixSize());
+        }
+        /*!
+             \brief Восстановление параметров фигуры из представления encoding
+             \param src - countParams * paramSize() байт, выравнивание не требуется
+         */
+        void decode(const void *src, size_t countParams, uint32_t lengthParams, double *dst) const
+        {
+            switch (encoding)
+            {
+            case eFloat32:
+                decodeAs<float>(src, countParams, lengthParams, dst);
+                break;
+            case eInt32:
+                decodeAs<int32_t>(src, countParams, lengthParams, dst);
+                break;
+            case eInt16:
+                decodeAs<int16_t>(src, countParams, lengthParams, dst);
+                break;
+            default:
+                decodeAs<double>(src, countParams, lengthParams, dst);
+                break;
+            }
+        }
+
+        /*!
+             \brief Дописывание заголовка в конец data. Для исходного формата ничего не пишется
+         */
+        void writeHeader(std::vector<uint8_t> &data) const
+        {
+            if (!header)
+                return;
+
+            const uint32_t fields[] = { VERSION, encoding, flags };
+            const double params[] = { originX, originY, scale };
+            const size_t pos = data.size();
+            data.resize(pos + HEADER_SIZE);
+            memcpy(data.data() + pos, MAGIC, sizeof(MAGIC));
+            memcpy(data.data() + pos + sizeof(MAGIC), fields, sizeof(fields));
+            memcpy(data.data() + pos + sizeof(MAGIC) + sizeof(fields), params, sizeof(params));
+        }
+        /*!
+             \brief Разбор заголовка из HEADER_SIZE байт
+             \return false, если заголовок испорчен или записан более новой версией
+         */
+        bool parseHeader(const uint8_t *src)
+        {
+            uint32_t fields[3];
+            double params[3];
+            if (memcmp(src, MAGIC, sizeof(MAGIC)) != 0)
+                return false;
+            memcpy(fields, src + sizeof(MAGIC), sizeof(fields));
+            memcpy(params, src + sizeof(MAGIC) + sizeof(fields), sizeof(params));
+            if (fields[0] != VERSION || fields[1] >= eCountEncodings || (fields[2] & ~KNOWN_FLAGS)
+                || !std::isfinite(params[0]) || !std::isfinite(params[1])
+                || !std::isfinite(params[2]) || !(params[2] > 0))
+                return false;
+
+            encoding = static_cast<Encoding>(fields[1]);
+            flags = fields[2];
+            originX = params[0];
+            originY = params[1];
+            scale = params[2];
+            header = true;
+            return true;
+        }
+    };
+
+    /*!
+         \brief Определение формата данных в памяти по их началу
+         \return false, если заголовок есть, но испорчен
+     */
+    inline bool detect(Utils::Span<const uint8_t> data, Format &format)
+    {
+        format = Format();
+        if (data.size() < sizeof(Format::MAGIC) || memcmp(data.data(), Format::MAGIC, sizeof(Format::MAGIC)) != 0)
+            return true;
+        return data.size() >= Format::HEADER_SIZE && format.parseHeader(data.data());
+    }
+    /*!
+         \brief Определение формата источника, стоящего в начале данных.
+                После успешного вызова источник стоит на первой записи.
+                Исходный формат распознается по тому, что magic не является допустимым Figure::Type
+         \return false, если заголовок испорчен или источник без заголовка не поддерживает seek()
+     */
+    inline bool detect(const Reader::IReader &reader, Format &format)
+    {
+        format = Format();
+        uint8_t header[Format::HEADER_SIZE];
+        if (!reader.read(header, sizeof(Format::MAGIC)) || memcmp(header, Format::MAGIC, sizeof(Format::MAGIC)) != 0)
+            return reader.seek(0);
+        return reader.read(header + sizeof(Format::MAGIC), Format::HEADER_SIZE - sizeof(Format::MAGIC))
+            && format.parseHeader(header);
+    }
+}
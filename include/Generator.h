@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "Compression.h"
+#include "Figure.h"
+#include "Format.h"
+
+namespace Generator
+{
+    /*!
+         \brief Распределение центров фигур по области
+     */
+    enum Distribution
+    {
+        eUniform,   ///< равномерно по всей области
+        eNormal,    ///< нормально вокруг центра области
+        eClusters   ///< нормально вокруг нескольких случайных центров, как города на карте
+    };
+
+    /*!
+         \brief Параметры генерации
+     */
+    struct Options
+    {
+        uint64_t size = 0;                                  ///< целевой размер данных, байт. Используется, если countRecords == 0
+        uint64_t countRecords = 0;                          ///< количество записей
+        std::array<double, Figure::eCountTypes> mix = {{ 1, 1, 1 }};  ///< относительные доли типов фигур
+        Distribution distribution = eUniform;
+        size_t countClusters = 16;
+        double extent = 1e6;                                ///< размер квадратной области [0, extent)
+        double minSize = 1;                                 ///< минимальный радиус описанной окружности фигуры
+        double maxSize = 100;                               ///< максимальный радиус описанной окружности фигуры
+        uint64_t seed = 1;
+        Format::Format format;                              ///< формат записей, по умолчанию исходный без заголовка
+    };
+
+    /*!
+         \brief Генератор записей в формате features.dat: Figure::Type и параметры,
+                по умолчанию double[countParams], или в версионном формате Options::format
+     */
+    class Generator
+    {
+        Options options;
+        std::mt19937_64 random;
+        std::discrete_distribution<int> types;
+        std::uniform_real_distribution<double> uniform{0, 1};
+        std::normal_distribution<double> normal{0, 1};
+        std::vector<std::pair<double, double>> clusters;
+
+        static constexpr double PI = 3.14159265358979323846;
+
+        void center(double &x, double &y)
+        {
+            switch (options.distribution)
+            {
+            case eNormal:
+                x = options.extent * (0.5 + normal(random) / 6);
+                y = options.extent * (0.5 + normal(random) / 6);
+                break;
+            case eClusters:
+            {
+                const auto &cluster = clusters[random() % clusters.size()];
+                x = cluster.first + options.extent * normal(random) / 50;
+                y = cluster.second + options.extent * normal(random) / 50;
+                break;
+            }
+            default:
+                x = options.extent * uniform(random);
+                y = options.extent * uniform(random);
+                break;
+            }
+        }
+        double size()
+        {
+            // логарифмически равномерно: мелких фигур больше, чем крупных
+            const double minSize = std::max(options.minSize, 1e-9);
+            const double maxSize = std::max(options.maxSize, minSize);
+            return minSize * std::pow(maxSize / minSize, uniform(random));
+        }
+        /*!
+             \brief Вершины правильного многоугольника со случайным поворотом
+         */
+        void poligon(double *points, size_t countPoints, double x, double y, double radius)
+        {
+            const double angle = 2 * PI * uniform(random);
+            for (size_t i = 0; i < countPoints; ++i)
+            {
+                const double a = angle + 2 * PI * i / countPoints;
+                points[2 * i] = x + radius * std::cos(a);
+                points[2 * i + 1] = y + radius * std::sin(a);
+            }
+        }
+
+    public:
+        explicit Generator(const Options &options_)
+            : options(options_),
+              random(options_.seed),
+              types(options_.mix.begin(), options_.mix.end())
+        {
+            std::uniform_real_distribution<double> position(0, options.extent);
+            for (size_t i = 0; i < std::max<size_t>(options.countClusters, 1); ++i)
+                clusters.emplace_back(position(random), position(random));
+        }
+
+        /*!
+             \brief Дописывание одной случайной записи в конец data
+         */
+        void append(std::vector<uint8_t> &data)
+        {
+            const Figure::Type type = static_cast<Figure::Type>(types(random));
+            double params[Figure::Square::COUNT_PARAMS];
+            size_t countParams = 0;
+            uint32_t lengthParams = 0;
+
+            double x, y;
+            center(x, y);
+            switch (type)
+            {
+            case Figure::eCircle:
+                params[0] = x;
+                params[1] = y;
+                params[2] = size();
+                countParams = Figure::Circle::COUNT_PARAMS;
+                lengthParams = Figure::Circle::LENGTH_PARAMS;
+                break;
+            case Figure::eTriangle:
+                poligon(params, Figure::Triangle::COUNT_PARAMS / 2, x, y, size());
+                countParams = Figure::Triangle::COUNT_PARAMS;
+                break;
+            default:
+                poligon(params, Figure::Square::COUNT_PARAMS / 2, x, y, size());
+                countParams = Figure::Square::COUNT_PARAMS;
+                break;
+            }
+
+            const size_t pos = data.size();
+            data.resize(pos + options.format.recordSize(countParams));
+            options.format.encodeRecord(type, params, countParams, lengthParams, data.data() + pos);
+        }
+
+        /*!
+             \brief Генерация данных в память
+         */
+        std::vector<uint8_t> generate()
+        {
+            std::vector<uint8_t> data;
+            options.format.writeHeader(data);
+            for (uint64_t i = 0; options.countRecords ? i < options.countRecords : data.size() < options.size; ++i)
+                append(data);
+            return data;
+        }
+
+        /*!
+             \brief Потоковая запись в файл блоками blockSize, без удержания всех данных в памяти
+             \return количество записанных записей или 0 при ошибке записи
+         */
+        uint64_t write(FILE *file, size_t blockSize = 4 << 20)
+        {
+            return generateBlocks(blockSize, [file](const std::vector<uint8_t> &block, uint32_t)
+            {
+                return ::fwrite(block.data(), 1, block.size(), file) == block.size();
+            });
+        }
+        /*!
+             \brief Потоковая запись в контейнер сжатых блоков примерно по blockSize байт целых записей
+             \return количество записанных записей или 0 при ошибке записи или недоступном алгоритме сжатия
+         */
+        uint64_t write(Compression::Writer &writer, size_t blockSize = 1 << 20)
+        {
+            if (!writer.writeHeader())
+                return 0;
+            return generateBlocks(blockSize, [&writer](const std::vector<uint8_t> &block, uint32_t countRecords)
+            {
+                return writer.writeBlock(block, countRecords);
+            });
+        }
+
+    private:
+        /*!
+             \brief Генерация блоками целых записей: flush(block, countRecords) по заполнении каждого блока
+         */
+        template <typename Flush>
+        uint64_t generateBlocks(size_t blockSize, Flush &&flush)
+        {
+            std::vector<uint8_t> block;
+            block.reserve(blockSize + options.format.headerSize() + options.format.recordSize(Figure::Square::COUNT_PARAMS));
+            options.format.writeHeader(block);
+
+            uint64_t countRecords = 0;
+            uint32_t blockRecords = 0;
+            uint64_t written = 0;
+            auto done = [&]()
+            {
+                return options.countRecords ? countRecords >= options.countRecords
+                                            : written + block.size() >= options.size;
+            };
+            while (!done())
+            {
+                append(block);
+                ++countRecords;
+                ++blockRecords;
+                if (block.size() >= blockSize)
+                {
+                    if (!flush(block, blockRecords))
+                        return 0;
+                    written += block.size();
+                    block.clear();
+                    blockRecords = 0;
+                }
+            }
+            if (!block.empty() && !flush(block, blockRecords))
+                return 0;
+            return countRecords;
+        }
+    };
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "Culling.h"
+#include "Feature.h"
+#include "Metrics.h"
+#include "Utils.h"
+
+namespace Lod
+{
+    /*!
+         \brief Упрощение пакета для мелкого масштаба. Фигуры, охват которых по обеим осям меньше
+                ячейки сетки (обычно - размера пикселя в мировых координатах), удаляются из пакета,
+                а вместо всех таких фигур одной ячейки добавляется один круг-точка диаметром в ячейку
+                с центром в среднем центров фигур. Крупные фигуры остаются как есть
+     */
+    class Simplifier
+    {
+        struct Cluster
+        {
+            double sumX = 0;
+            double sumY = 0;
+            size_t count = 0;
+            uint64_t id = std::numeric_limits<uint64_t>::max();   ///< наименьший номер записи ячейки
+        };
+
+        /*!
+             \brief Начальная позиция ключа в таблице на 2^(64 - shift) позиций.
+                    Старшие биты произведения зависят от обеих половин ключа
+         */
+        static size_t start(uint64_t key, unsigned shift) { return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> shift); }
+
+        /*!
+             \brief Номера кластеров по ключам ячеек с открытой адресацией: без выделения памяти
+                    на каждую ячейку, как в std::unordered_map. Сами ключи лежат в cells по номерам кластеров
+         */
+        class ClusterTable
+        {
+            const std::vector<uint64_t> &cells;
+            std::vector<uint32_t> slots;    ///< номер кластера + 1, 0 - пустая позиция
+            size_t mask = 0;
+            unsigned shift = 64;
+
+            size_t start(uint64_t key) const { return Simplifier::start(key, shift); }
+            void grow()
+            {
+                slots.assign(slots.empty() ? 1024 : 2 * slots.size(), 0);
+                mask = slots.size() - 1;
+                shift = 64 - __builtin_ctzll(slots.size());
+                for (size_t i = 0; i < cells.size(); ++i)
+                {
+                    size_t pos = start(cells[i]);
+                    while (slots[pos])
+                        pos = (pos + 1) & mask;
+                    slots[pos] = static_cast<uint32_t>(i + 1);
+                }
+            }
+
+        public:
+            explicit ClusterTable(const std::vector<uint64_t> &cells_)
+                : cells(cells_)
+            {
+                grow();
+            }
+            /*!
+                 \brief Номер кластера ячейки key или cells.size(), если ячейки еще нет.
+                        Новый ключ затем добавляется в cells вызывающим
+             */
+            size_t find(uint64_t key)
+            {
+                if (2 * (cells.size() + 1) > slots.size())
+                    grow();
+                size_t pos = start(key);
+                for (; slots[pos]; pos = (pos + 1) & mask)
+                    if (cells[slots[pos] - 1] == key)
+                        return slots[pos] - 1;
+                slots[pos] = static_cast<uint32_t>(cells.size() + 1);
+                return cells.size();
+            }
+        };
+
+        double _cellSize;
+        double _inverseCellSize;
+
+        /*!
+             \brief Ключ ячейки: номера столбца и строки, прижатые к int32
+         */
+        uint64_t cell(double x, double y) const
+        {
+            auto index = [this](double value)
+            {
+                const double res = std::floor(value * _inverseCellSize);
+                const double low = std::numeric_limits<int32_t>::min();
+                const double high = std::numeric_limits<int32_t>::max();
+                // NaN попадает в крайнюю ячейку, а не в неопределенное преобразование
+                return static_cast<uint32_t>(static_cast<int32_t>(res >= high ? high : res > low ? res : low));
+            };
+            return (static_cast<uint64_t>(index(x)) << 32) | index(y);
+        }
+
+    public:
+        struct Result
+        {
+            size_t countCollapsed = 0;  ///< удалено мелких фигур
+            size_t countClusters = 0;   ///< добавлено кругов-точек
+        };
+
+        /*!
+             \param cellSize - сторона ячейки в координатах фигур, больше 0
+         */
+        explicit Simplifier(double cellSize)
+            : _cellSize(cellSize),
+              _inverseCellSize(1 / cellSize)
+        {
+        }
+        double cellSize() const { return _cellSize; }
+
+        /*!
+             \brief Ячейки, точки которых уже отданы на отрисовку: множество ключей с открытой адресацией
+                    в одном массиве. Ключ ~0 занят под пустую позицию, поэтому его наличие хранится отдельно
+         */
+        class Cells
+        {
+            static constexpr uint64_t EMPTY = ~uint64_t(0);
+
+            std::vector<uint64_t> slots;
+            size_t count = 0;
+            unsigned shift = 64;
+            bool hasEmpty = false;
+
+            void place(uint64_t key)
+            {
+                size_t pos = start(key, shift);
+                while (slots[pos] != EMPTY)
+                    pos = (pos + 1) & (slots.size() - 1);
+                slots[pos] = key;
+            }
+            void grow()
+            {
+                std::vector<uint64_t> old(slots.empty() ? 1024 : 2 * slots.size(), EMPTY);
+                old.swap(slots);
+                shift = 64 - __builtin_ctzll(slots.size());
+                for (uint64_t key : old)
+                    if (key != EMPTY)
+                        place(key);
+            }
+
+        public:
+            size_t size() const { return count + hasEmpty; }
+            bool contains(uint64_t key) const
+            {
+                if (key == EMPTY)
+                    return hasEmpty;
+                if (slots.empty())
+                    return false;
+                for (size_t pos = start(key, shift); slots[pos] != EMPTY; pos = (pos + 1) & (slots.size() - 1))
+                    if (slots[pos] == key)
+                        return true;
+                return false;
+            }
+            void insert(uint64_t key)
+            {
+                if (key == EMPTY)
+                {
+                    hasEmpty = true;
+                    return;
+                }
+                if (contains(key))
+                    return;
+                if (2 * (count + 1) > slots.size())
+                    grow();
+                place(key);
+                ++count;
+            }
+            void clear()
+            {
+                std::fill(slots.begin(), slots.end(), EMPTY);
+                count = 0;
+                hasEmpty = false;
+            }
+        };
+
+        /*!
+             \brief Упрощение на месте. Пакет без мелких фигур не перестраивается
+             \param drawn - ячейки с точками из предыдущих пакетов того же кадра: мелкие фигуры в них
+                    удаляются без новой точки, а ячейки новых точек добавляются. nullptr - без учета
+         */
+        Result simplify(FeatureBatch &batch, Cells *drawn = nullptr) const
+        {
+            Result res;
+            if (!(_cellSize > 0))
+                return res;
+
+            std::vector<uint64_t> cells;    ///< ключи ячеек кластеров
+            std::vector<Cluster> clusters;
+            ClusterTable table(cells);
+            size_t countCollapsed = 0;
+            auto collapse = [&](double x, double y, uint64_t id)
+            {
+                ++countCollapsed;
+                const uint64_t key = cell(x, y);
+                if (drawn && drawn->contains(key))
+                    return;
+                const size_t index = table.find(key);
+                if (index == clusters.size())
+                {
+                    clusters.emplace_back();
+                    cells.push_back(key);
+                }
+                Cluster &cluster = clusters[index];
+                cluster.sumX += x;
+                cluster.sumY += y;
+                ++cluster.count;
+                cluster.id = std::min(cluster.id, id);
+            };
+
+            FeatureBatch::Selection keep;
+            const FeatureBatch::Circles &circles = batch.circles;
+            keep.circles.assign(circles.size(), true);
+            for (size_t i = 0; i < circles.size(); ++i)
+            {
+                if (!(2 * circles.radius[i] < _cellSize))
+                    continue;
+                keep.circles.set(i, false);
+                collapse(circles.centerX[i], circles.centerY[i], circles.ids[i]);
+            }
+
+            Culling::Bounds bounds;
+            const std::pair<const FeatureBatch::Poligons*, Utils::Bitmap*> groups[] = {
+                { &batch.triangles, &keep.triangles }, { &batch.squares, &keep.squares } };
+            for (const auto &group : groups)
+            {
+                Culling::bounds(*group.first, bounds);
+                group.second->assign(group.first->size(), true);
+                for (size_t i = 0; i < bounds.size(); ++i)
+                {
+                    if (!(bounds.maxX[i] - bounds.minX[i] < _cellSize && bounds.maxY[i] - bounds.minY[i] < _cellSize))
+                        continue;
+                    group.second->set(i, false);
+                    collapse((bounds.minX[i] + bounds.maxX[i]) / 2, (bounds.minY[i] + bounds.maxY[i]) / 2, group.first->ids[i]);
+                }
+            }
+            if (!countCollapsed)
+                return res;
+
+            res.countCollapsed = countCollapsed;
+            res.countClusters = clusters.size();
+            if (drawn)
+                for (uint64_t key : cells)
+                    drawn->insert(key);
+            batch.filter(keep);
+
+            for (const Cluster &cluster : clusters)
+            {
+                Figure::Record<Figure::Circle> point;
+                point.params = {{ cluster.sumX / cluster.count, cluster.sumY / cluster.count, _cellSize / 2 }};
+                batch.append(point, cluster.id);
+            }
+            PROSOFT_COUNT(eFiguresCollapsed, res.countCollapsed);
+            return res;
+        }
+    };
+}
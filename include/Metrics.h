@@ -0,0 +1,331 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Figure.h"
+
+/*!
+     \brief Сбор счетчиков и времени стадий. PROSOFT_METRICS=0 убирает все точки сбора
+            PROSOFT_COUNT* и PROSOFT_TIME_SCOPE из кода, снимок тогда остается нулевым
+ */
+#ifndef PROSOFT_METRICS
+#define PROSOFT_METRICS 0
+#endif
+
+namespace Metrics
+{
+    enum Counter
+    {
+        eBytesRead,         ///< прочитано байт из файлов
+        ePrototypeHits,     ///< записи, фигура которых взята из таблицы прототипов фабрики
+        ePrototypeMisses,   ///< записи с незарегистрированным типом
+        eDrawCalls,         ///< вызовы IDrawer
+        eFiguresDrawn,      ///< фигуры, переданные на отрисовку
+        eRecordsRejected,   ///< записи, отброшенные как испорченные
+        eFiguresCulled,     ///< фигуры, отсеченные вне видимой области
+        eFiguresCollapsed,  ///< мелкие фигуры, замененные точками Lod
+        eRecordsSkipped,    ///< записи незарегистрированного типа, пропущенные по префиксу длины
+        eMeshesBuilt,       ///< сетки многоугольников, построенные Tessellation::Cache
+        eMeshesReused,      ///< отрисовки готовой сеткой из Tessellation::Cache
+
+        eCountCounters
+    };
+
+    enum Stage
+    {
+        eRead,
+        eDecode,
+        eValidate,
+        eCull,
+        eLod,
+        eDraw,
+
+        eCountStages
+    };
+
+    /*!
+         \brief Сумма счетчиков всех потоков на момент снятия
+     */
+    struct Snapshot
+    {
+        std::array<uint64_t, eCountCounters> counters{};
+        std::array<uint64_t, Figure::eCountTypes> records{};    ///< декодировано записей по типам
+        std::array<uint64_t, eCountStages> stageNanoseconds{};
+        std::array<uint64_t, eCountStages> stageCalls{};
+
+        Snapshot &operator+=(const Snapshot &other)
+        {
+            for (size_t i = 0; i < counters.size(); ++i)
+                counters[i] += other.counters[i];
+            for (size_t i = 0; i < records.size(); ++i)
+                records[i] += other.records[i];
+            for (size_t i = 0; i < stageNanoseconds.size(); ++i)
+            {
+                stageNanoseconds[i] += other.stageNanoseconds[i];
+                stageCalls[i] += other.stageCalls[i];
+            }
+            return *this;
+        }
+        /*!
+             \brief Приращение с момента снятия other
+         */
+        Snapshot operator-(const Snapshot &other) const
+        {
+            Snapshot res = *this;
+            for (size_t i = 0; i < counters.size(); ++i)
+                res.counters[i] -= other.counters[i];
+            for (size_t i = 0; i < records.size(); ++i)
+                res.records[i] -= other.records[i];
+            for (size_t i = 0; i < stageNanoseconds.size(); ++i)
+            {
+                res.stageNanoseconds[i] -= other.stageNanoseconds[i];
+                res.stageCalls[i] -= other.stageCalls[i];
+            }
+            return res;
+        }
+    };
+
+    namespace Detail
+    {
+        /*!
+             \brief Счетчики одного потока. Пишет только поток-владелец, поэтому приращение
+                    обходится без атомарного сложения, а атомарность нужна лишь для чтения снимка
+         */
+        struct Local
+        {
+            std::array<std::atomic<uint64_t>, eCountCounters> counters{};
+            std::array<std::atomic<uint64_t>, Figure::eCountTypes> records{};
+            std::array<std::atomic<uint64_t>, eCountStages> stageNanoseconds{};
+            std::array<std::atomic<uint64_t>, eCountStages> stageCalls{};
+
+            static void add(std::atomic<uint64_t> &value, uint64_t delta)
+            {
+                value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+            }
+            void addTo(Snapshot &snapshot) const
+            {
+                for (size_t i = 0; i < counters.size(); ++i)
+                    snapshot.counters[i] += counters[i].load(std::memory_order_relaxed);
+                for (size_t i = 0; i < records.size(); ++i)
+                    snapshot.records[i] += records[i].load(std::memory_order_relaxed);
+                for (size_t i = 0; i < stageNanoseconds.size(); ++i)
+                {
+                    snapshot.stageNanoseconds[i] += stageNanoseconds[i].load(std::memory_order_relaxed);
+                    snapshot.stageCalls[i] += stageCalls[i].load(std::memory_order_relaxed);
+                }
+            }
+        };
+
+        /*!
+             \brief Счетчики живых потоков и накопленные итоги завершившихся
+         */
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<const Local*> live;
+            Snapshot retired;
+
+            static Registry &instance()
+            {
+                static Registry registry;
+                return registry;
+            }
+        };
+
+        /*!
+             \brief Регистрация счетчиков потока при первом обращении и перенос их в итоги при завершении
+         */
+        class Holder
+        {
+            Local data;
+
+        public:
+            Holder()
+            {
+                Registry &registry = Registry::instance();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.live.push_back(&data);
+            }
+            ~Holder()
+            {
+                Registry &registry = Registry::instance();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                data.addTo(registry.retired);
+                for (size_t i = 0; i < registry.live.size(); ++i)
+                {
+                    if (registry.live[i] == &data)
+                    {
+                        registry.live[i] = registry.live.back();
+                        registry.live.pop_back();
+                        break;
+                    }
+                }
+            }
+            Local &local() { return data; }
+        };
+
+        inline Local &local()
+        {
+            thread_local Holder holder;
+            return holder.local();
+        }
+    }
+
+    inline void add(Counter counter, uint64_t delta)
+    {
+        Detail::Local::add(Detail::local().counters[counter], delta);
+    }
+    inline void addRecords(Figure::Type type, uint64_t delta)
+    {
+        if (type >= 0 && type < Figure::eCountTypes)
+            Detail::Local::add(Detail::local().records[type], delta);
+    }
+    inline void addStage(Stage stage, uint64_t nanoseconds)
+    {
+        Detail::Local &local = Detail::local();
+        Detail::Local::add(local.stageNanoseconds[stage], nanoseconds);
+        Detail::Local::add(local.stageCalls[stage], 1);
+    }
+
+    /*!
+         \brief Замер времени от создания до конца области видимости
+     */
+    class ScopedTimer
+    {
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit ScopedTimer(Stage stage_)
+        : stage(stage_),
+          start(std::chrono::steady_clock::now())
+        {
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer &operator=(const ScopedTimer&) = delete;
+        ~ScopedTimer()
+        {
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            addStage(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+    };
+
+    inline Snapshot snapshot()
+    {
+        Detail::Registry &registry = Detail::Registry::instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Snapshot res = registry.retired;
+        for (const Detail::Local *local : registry.live)
+            local->addTo(res);
+        return res;
+    }
+
+    inline const char *name(Counter counter)
+    {
+        static const char *NAMES[eCountCounters] = {
+            "bytes_read", "prototype_hits", "prototype_misses", "draw_calls",
+            "figures_drawn", "records_rejected", "figures_culled", "figures_collapsed", "records_skipped",
+            "meshes_built", "meshes_reused" };
+        return NAMES[counter];
+    }
+    inline const char *name(Stage stage)
+    {
+        static const char *NAMES[eCountStages] = { "read", "decode", "validate", "cull", "lod", "draw" };
+        return NAMES[stage];
+    }
+    inline const char *name(Figure::Type type)
+    {
+        static const char *NAMES[Figure::eCountTypes] = { "circle", "triangle", "square" };
+        return type >= 0 && type < Figure::eCountTypes ? NAMES[type] : "unknown";
+    }
+
+    /*!
+         \brief Снимок одной строкой JSON
+     */
+    inline std::string toJson(const Snapshot &snapshot)
+    {
+        std::string res = "{\"counters\":{";
+        char buffer[128];
+        for (size_t i = 0; i < eCountCounters; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%s\"%s\":%llu", i ? "," : "", name(static_cast<Counter>(i)),
+                          static_cast<unsigned long long>(snapshot.counters[i]));
+            res += buffer;
+        }
+        res += "},\"records\":{";
+        for (size_t i = 0; i < Figure::eCountTypes; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%s\"%s\":%llu", i ? "," : "", name(static_cast<Figure::Type>(i)),
+                          static_cast<unsigned long long>(snapshot.records[i]));
+            res += buffer;
+        }
+        res += "},\"stages\":{";
+        for (size_t i = 0; i < eCountStages; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"seconds\":%.9f,\"calls\":%llu}", i ? "," : "",
+                          name(static_cast<Stage>(i)), snapshot.stageNanoseconds[i] * 1e-9,
+                          static_cast<unsigned long long>(snapshot.stageCalls[i]));
+            res += buffer;
+        }
+        res += "}}";
+        return res;
+    }
+
+    /*!
+         \brief Снимок в текстовом формате Prometheus
+     */
+    inline std::string toPrometheus(const Snapshot &snapshot)
+    {
+        std::string res;
+        char buffer[160];
+        for (size_t i = 0; i < eCountCounters; ++i)
+        {
+            const char *counter = name(static_cast<Counter>(i));
+            std::snprintf(buffer, sizeof(buffer), "# TYPE prosoft_%s_total counter\nprosoft_%s_total %llu\n",
+                          counter, counter, static_cast<unsigned long long>(snapshot.counters[i]));
+            res += buffer;
+        }
+        res += "# TYPE prosoft_records_decoded_total counter\n";
+        for (size_t i = 0; i < Figure::eCountTypes; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "prosoft_records_decoded_total{type=\"%s\"} %llu\n",
+                          name(static_cast<Figure::Type>(i)), static_cast<unsigned long long>(snapshot.records[i]));
+            res += buffer;
+        }
+        res += "# TYPE prosoft_stage_seconds_total counter\n";
+        for (size_t i = 0; i < eCountStages; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "prosoft_stage_seconds_total{stage=\"%s\"} %.9f\n",
+                          name(static_cast<Stage>(i)), snapshot.stageNanoseconds[i] * 1e-9);
+            res += buffer;
+        }
+        res += "# TYPE prosoft_stage_calls_total counter\n";
+        for (size_t i = 0; i < eCountStages; ++i)
+        {
+            std::snprintf(buffer, sizeof(buffer), "prosoft_stage_calls_total{stage=\"%s\"} %llu\n",
+                          name(static_cast<Stage>(i)), static_cast<unsigned long long>(snapshot.stageCalls[i]));
+            res += buffer;
+        }
+        return res;
+    }
+}
+
+#define PROSOFT_METRICS_CONCAT_(a, b) a##b
+#define PROSOFT_METRICS_CONCAT(a, b) PROSOFT_METRICS_CONCAT_(a, b)
+
+#if PROSOFT_METRICS
+#define PROSOFT_COUNT(counter, delta) ::Metrics::add(::Metrics::counter, (delta))
+#define PROSOFT_COUNT_RECORDS(type, delta) ::Metrics::addRecords((type), (delta))
+#define PROSOFT_TIME_SCOPE(stage) const ::Metrics::ScopedTimer PROSOFT_METRICS_CONCAT(prosoftTimer, __LINE__)(::Metrics::stage)
+#else
+#define PROSOFT_COUNT(counter, delta) ((void)0)
+#define PROSOFT_COUNT_RECORDS(type, delta) ((void)0)
+#define PROSOFT_TIME_SCOPE(stage) ((void)0)
+#endif
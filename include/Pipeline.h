@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "Culling.h"
+#include "Drawer.h"
+#include "Feature.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Lod.h"
+#include "Metrics.h"
+#include "Reader.h"
+#include "Scheduler.h"
+#include "Tessellation.h"
+#include "Validation.h"
+
+namespace Pipeline
+{
+    /*!
+         \brief Ограниченная lock-free очередь с одним производителем и одним потребителем.
+                Ожидающая сторона сначала недолго крутится, а затем засыпает до уведомления,
+                так что простой стадии (например, Reader::Tail ждет данных) не занимает ядро
+     */
+    template <typename T>
+    class Queue
+    {
+        static const size_t SPINS = 64;  ///< попыток перед засыпанием
+
+        std::vector<T> slots;
+        alignas(64) std::atomic<size_t> head{0};    ///< следующий для чтения, меняет потребитель
+        alignas(64) std::atomic<size_t> tail{0};    ///< следующий для записи, меняет производитель
+        alignas(64) std::atomic<bool> closed{false};
+        std::atomic<size_t> sleeping{0};    ///< уснувшие в wait(), будить нужно только их
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        /*!
+             \brief Пробуждение уснувшей стороны после изменения head, tail или closed
+         */
+        void notify()
+        {
+            // изменения head, tail, closed и sleeping упорядочены seq_cst: либо здесь виден
+            // уснувший, либо он после sleeping.fetch_add() увидит изменение
+            if (!sleeping.load())
+                return;
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_all();
+        }
+        template <typename Ready>
+        void wait(Ready &&ready)
+        {
+            for (size_t i = 0; i < SPINS; ++i)
+            {
+                if (ready())
+                    return;
+                std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            sleeping.fetch_add(1);
+            cv.wait(lock, ready);
+            sleeping.fetch_sub(1);
+        }
+
+    public:
+        explicit Queue(size_t capacity)
+            : slots(std::max<size_t>(capacity, 1) + 1)
+        {
+        }
+        bool tryPush(T &value)
+        {
+            const size_t pos = tail.load(std::memory_order_relaxed);
+            const size_t next = (pos + 1) % slots.size();
+            if (next == head.load(std::memory_order_acquire))
+                return false;
+            slots[pos] = std::move(value);
+            tail.store(next);
+            notify();
+            return true;
+        }
+        bool tryPop(T &value)
+        {
+            const size_t pos = head.load(std::memory_order_relaxed);
+            if (pos == tail.load(std::memory_order_acquire))
+                return false;
+            value = std::move(slots[pos]);
+            head.store((pos + 1) % slots.size());
+            notify();
+            return true;
+        }
+        /*!
+             \brief Запись с ожиданием свободного места (обратное давление на производителя)
+         */
+        void push(T &value)
+        {
+            while (!tryPush(value))
+            {
+                wait([this]()
+                {
+                    return (tail.load(std::memory_order_relaxed) + 1) % slots.size() != head.load();
+                });
+            }
+        }
+        /*!
+             \brief Чтение с ожиданием данных
+             \return false, если очередь закрыта и пуста
+         */
+        bool pop(T &value)
+        {
+            while (!tryPop(value))
+            {
+                if (closed.load(std::memory_order_acquire))
+                    return tryPop(value);
+                wait([this]()
+                {
+                    return head.load(std::memory_order_relaxed) != tail.load() || closed.load();
+                });
+            }
+            return true;
+        }
+        /*!
+             \brief Завершение записи, вызывается производителем
+         */
+        void close()
+        {
+            closed.store(true);
+            notify();
+        }
+    };
+
+    /*!
+         \brief Конвейер чтения, декодирования и отрисовки.
+                Чтение и декодирование выполняются в своих потоках, отрисовка - в вызывающем,
+                а для потокобезопасного IDrawer - еще и задачами общего пула.
+                Стадии ждут друг друга в очередях, поэтому это отдельные потоки, а не задачи пула.
+                Между стадиями ходят блоки записей через ограниченные очереди, а
+                отработавшие блоки возвращаются обратно, так что память постоянна
+     */
+    class Executor
+    {
+        const Figure::Factory &figureFactory;
+        size_t blockRecords;
+        size_t queueDepth;
+        std::optional<Utils::Rect> viewport;
+        std::optional<Validation::Validator> validator{Validation::Validator()};
+        std::optional<Lod::Simplifier> lod;
+        Format::Format dataFormat;
+        Tessellation::Cache *meshCache = nullptr;
+
+        /*!
+             \brief Сырые байты подряд идущих записей
+         */
+        struct Block
+        {
+            std::vector<uint8_t> data;
+            uint64_t firstId = 0;
+            size_t countRecords = 0;
+        };
+
+    public:
+        struct Result
+        {
+            uint64_t countRecords = 0;  ///< декодировано записей
+            uint64_t countDrawn = 0;    ///< передано на отрисовку фигур
+            uint64_t countRejected = 0; ///< отброшено проверкой фигур с недопустимыми параметрами
+            /*!
+                 \brief Прочитано байт целых записей, без заголовка формата. Чтение дописываемого файла
+                        продолжается со смещения первой записи плюс countBytes, то есть для файла,
+                        прочитанного с начала, - с Format::Format::headerSize() + countBytes
+             */
+            uint64_t countBytes = 0;
+            bool ok = true;             ///< false, если чтение прервалось на испорченной записи или блок декодировался не целиком
+        };
+
+        /*!
+             \param blockRecords - количество записей в блоке между стадиями
+             \param queueDepth - количество блоков в очереди между стадиями
+         */
+        explicit Executor(const Figure::Factory &figureFactory, size_t blockRecords = 4096, size_t queueDepth = 4)
+            : figureFactory(figureFactory),
+              blockRecords(std::max<size_t>(blockRecords, 1)),
+              queueDepth(std::max<size_t>(queueDepth, 1))
+        {
+        }
+
+        /*!
+             \brief Включение отсечения фигур вне видимой области перед отрисовкой
+         */
+        void setViewport(const Utils::Rect &rect) { viewport = rect; }
+        void resetViewport() { viewport.reset(); }
+        /*!
+             \brief Проверка декодированных фигур перед отсечением и отрисовкой. Включена по умолчанию,
+                    недопустимые фигуры пропускаются, а чтение продолжается
+         */
+        void setValidator(const Validation::Validator &value) { validator = value; }
+        void resetValidator() { validator.reset(); }
+        /*!
+             \brief Замена фигур мельче cellSize точками по ячейкам сетки после отсечения, см. Lod::Simplifier.
+                    Точка ячейки рисуется один раз за run()
+         */
+        void setLod(double cellSize) { lod = Lod::Simplifier(cellSize); }
+        void resetLod() { lod.reset(); }
+        /*!
+             \brief Формат записей источника, см. Format::detect(). По умолчанию исходный
+         */
+        void setFormat(const Format::Format &format) { dataFormat = format; }
+        /*!
+             \brief Отрисовка многоугольников сетками из cache, если drawer.hasMeshes().
+                    Блоки записей источника одни и те же от run() к run(), поэтому повторная
+                    отрисовка того же источника берет сетки из кэша. При смене источника
+                    или изменении его записей кэш очищается вызывающим, см. Tessellation::Cache.
+                    Кэш должен жить дольше Executor
+         */
+        void setMeshCache(Tessellation::Cache &cache) { meshCache = &cache; }
+        void resetMeshCache() { meshCache = nullptr; }
+
+        /*!
+             \brief Чтение, декодирование и отрисовка всех записей источника.
+                    С Reader::Tail блоки отдаются на отрисовку, как только источник начинает ждать,
+                    а запись, оборванная stop(), прерывает чтение с ok = false
+                    и не входит в countBytes
+         */
+        Result run(const Reader::IReader &reader, const Drawer::IDrawer &drawer) const
+        {
+            const size_t countItems = queueDepth + 2;   // по одному в работе у каждой стадии плюс очередь
+            Queue<Block> blocks(queueDepth), freeBlocks(countItems);
+            Queue<FeatureBatch> batches(queueDepth), freeBatches(countItems);
+            for (size_t i = 0; i < countItems; ++i)
+            {
+                Block block;
+                freeBlocks.push(block);
+                FeatureBatch batch;
+                freeBatches.push(batch);
+            }
+
+            Result result;
+            std::atomic<bool> readOk{true};
+            uint64_t countBytes = 0;
+            std::thread readStage([&]()
+            {
+                uint64_t id = 0;
+                uint64_t countSkipped = 0;
+                Block block;
+                bool more = true;
+                while (more && freeBlocks.pop(block))
+                {
+                    PROSOFT_TIME_SCOPE(eRead);
+                    block.data.clear();
+                    block.firstId = id;
+                    block.countRecords = 0;
+                    while (block.countRecords < blockRecords && (more = readRecord(reader, block.data, readOk, countSkipped)))
+                    {
+                        ++block.countRecords;
+                        // неполный блок уходит сразу, если следующей записи источник еще ждет
+                        if (!reader.available())
+                            break;
+                    }
+                    id += block.countRecords;
+                    countBytes += block.data.size() + countSkipped;
+                    countSkipped = 0;
+                    PROSOFT_COUNT(ePrototypeHits, block.countRecords);
+                    if (block.countRecords)
+                        blocks.push(block);
+                }
+                blocks.close();
+            });
+            uint64_t countDecoded = 0;
+            uint64_t countRejected = 0;
+            bool decodeOk = true;
+            std::thread decodeStage([&]()
+            {
+                const TypedFeature<Figure::Figures> feature(dataFormat, &figureFactory);
+                Lod::Simplifier::Cells drawnCells;
+                Block block;
+                FeatureBatch batch;
+                while (blocks.pop(block))
+                {
+                    freeBatches.pop(batch);
+                    batch.clear();
+                    {
+                        PROSOFT_TIME_SCOPE(eDecode);
+                        Reader::Memory memory(block.data);
+                        const size_t count = batch.read(feature, memory, block.countRecords, block.firstId);
+                        countDecoded += count;
+                        decodeOk = decodeOk && count == block.countRecords;
+                    }
+                    freeBlocks.push(block);
+                    if (validator)
+                    {
+                        PROSOFT_TIME_SCOPE(eValidate);
+                        countRejected += validator->validate(batch);
+                    }
+                    if (viewport)
+                    {
+                        PROSOFT_TIME_SCOPE(eCull);
+                        Culling::Viewport(*viewport).cull(batch);
+                    }
+                    if (lod)
+                    {
+                        PROSOFT_TIME_SCOPE(eLod);
+                        lod->simplify(batch, &drawnCells);
+                    }
+                    batches.push(batch);
+                }
+                batches.close();
+            });
+
+            FeatureBatch batch;
+            while (batches.pop(batch))
+            {
+                PROSOFT_TIME_SCOPE(eDraw);
+                if (meshCache)
+                    meshCache->draw(drawer, batch);
+                else
+                    batch.draw(drawer, Scheduler::Pool::shared());
+                result.countDrawn += batch.size();
+                freeBatches.push(batch);
+            }
+
+            readStage.join();
+            decodeStage.join();
+            result.countRecords = countDecoded;
+            result.countRejected = countRejected;
+            result.countBytes = countBytes;
+            result.ok = readOk && decodeOk;
+            return result;
+        }
+
+    private:
+        /*!
+             \brief Дописывание сырых байт одной записи в конец data. Записи незарегистрированных типов
+                    в формате с префиксом длины пропускаются, и их размер прибавляется к countSkipped.
+                    Так же пропускается расширение записи после параметров фигуры, а ее префикс
+                    длины в data исправляется на длину параметров
+             \return false в конце данных или при ошибке (тогда ok сбрасывается)
+         */
+        bool readRecord(const Reader::IReader &reader, std::vector<uint8_t> &data, std::atomic<bool> &ok, uint64_t &countSkipped) const
+        {
+            const size_t pos = data.size();
+            while (true)
+            {
+                data.resize(pos + dataFormat.prefixSize());
+                if (!reader.read(data.data() + pos, dataFormat.prefixSize()))
+                    break;
+                Figure::Type type;
+                uint32_t length = 0;
+                memcpy(&type, data.data() + pos, sizeof(type));
+                if (dataFormat.hasLengthPrefix())
+                    memcpy(&length, data.data() + pos + sizeof(type), sizeof(length));
+
+                const Figure::Figure *figure = figureFactory.prototype(type);
+                if (!figure)
+                    PROSOFT_COUNT(ePrototypeMisses, 1);
+                if (!figure && dataFormat.hasLengthPrefix())
+                {
+                    if (!Reader::skip(reader, length))
+                        return reject(data, pos, ok);
+                    PROSOFT_COUNT(eRecordsSkipped, 1);
+                    countSkipped += dataFormat.prefixSize() + length;
+                    continue;
+                }
+                size_t countParams = 0;
+                if (!figure || !dataFormat.countParams(figure->countParams(), length, countParams))
+                    return reject(data, pos, ok);
+
+                // размер ограничен Format::countParams(), а расширение записи не буферизуется
+                const size_t size = countParams * dataFormat.paramSize();
+                data.resize(pos + dataFormat.prefixSize() + size);
+                if (!reader.read(data.data() + pos + dataFormat.prefixSize(), size))
+                    return reject(data, pos, ok);
+                if (dataFormat.hasLengthPrefix() && length != size)
+                {
+                    if (!Reader::skip(reader, length - size))
+                        return reject(data, pos, ok);
+                    const uint32_t stored = static_cast<uint32_t>(size);
+                    memcpy(data.data() + pos + sizeof(type), &stored, sizeof(stored));
+                    countSkipped += length - size;
+                }
+                return true;
+            }
+            data.resize(pos);
+            return false;
+        }
+        static bool reject(std::vector<uint8_t> &data, size_t pos, std::atomic<bool> &ok)
+        {
+            data.resize(pos);
+            ok = false;
+            PROSOFT_COUNT(eRecordsRejected, 1);
+            return false;
+        }
+    };
+}
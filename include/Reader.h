@@ -0,0 +1,1243 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PROSOFT_HAS_MMAP 1
+#endif
+#if defined(PROSOFT_HAS_MMAP) && __has_include(<poll.h>)
+#include <poll.h>
+#define PROSOFT_HAS_TAIL 1
+#endif
+#if defined(PROSOFT_HAS_MMAP) && __has_include(<linux/io_uring.h>) && __has_include(<sys/syscall.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define PROSOFT_HAS_URING 1
+#endif
+#if __has_include(<sys/inotify.h>)
+#include <sys/inotify.h>
+#define PROSOFT_HAS_INOTIFY 1
+#endif
+
+#include "Compression.h"
+#include "Metrics.h"
+#include "Scheduler.h"
+#include "Utils.h"
+
+namespace Reader
+{
+    /*!
+         \brief Интерфейс к объекту читателю
+     */
+    class IReader
+    {
+    public:
+        virtual ~IReader() = default;
+        virtual bool read(void *dst, size_t size, size_t count = 1) const = 0;
+        /*!
+             \brief Получение данных без копирования
+             \return указатель на данные внутри источника или nullptr, если источник этого не поддерживает.
+                     При успехе позиция чтения сдвигается так же, как после read()
+         */
+        virtual const void *view(size_t /*size*/, size_t /*count*/ = 1) const { return nullptr; }
+        /*!
+             \brief Переход к абсолютному смещению offset от начала данных
+             \return false, если источник не поддерживает произвольный доступ
+         */
+        virtual bool seek(uint64_t /*offset*/) const { return false; }
+        /*!
+             \brief Количество байт, которые можно прочитать без ожидания.
+                    SIZE_MAX - источник никогда не ждет данных, как обычный файл или память
+         */
+        virtual size_t available() const { return SIZE_MAX; }
+    };
+    /*!
+         \brief Пропуск size байт источника: без копирования, если он отдает их через view()
+         \return false, если данные кончились раньше
+     */
+    inline bool skip(const IReader &reader, uint64_t size)
+    {
+        if (size <= SIZE_MAX && reader.view(1, static_cast<size_t>(size)))
+            return true;
+        uint8_t buffer[4096];
+        while (size)
+        {
+            const size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, sizeof(buffer)));
+            if (!reader.read(buffer, chunk))
+                return false;
+            size -= chunk;
+        }
+        return true;
+    }
+    /*!
+         \brief Чтение данных из файла
+     */
+    class File : public IReader
+    {
+        std::unique_ptr<FILE, std::function<void(FILE*)>> file;
+    public:
+        explicit File(const std::string &filename)
+            : file(::fopen(filename.c_str(), "rb"), [](FILE* f) { ::fclose(f); })
+        {
+        }
+        bool read(void *dst, size_t size, size_t count = 1) const
+        {
+            if (!dst || !file)
+                return false;
+
+            if (::fread(dst, size, count, file.get()) != count)
+                return false;
+            PROSOFT_COUNT(eBytesRead, size * count);
+            return true;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            return file && ::fseeko(file.get(), static_cast<off_t>(offset), SEEK_SET) == 0;
+        }
+    };
+
+    /*!
+         \brief Чтение файла крупными блоками через промежуточный буфер.
+                При включенном упреждающем чтении следующий блок читается
+                отдельным потоком, пока обрабатывается текущий
+     */
+    class BufferedFile : public IReader
+    {
+        struct Block
+        {
+            std::vector<uint8_t> data;
+            size_t size = 0;
+            size_t pos = 0;
+        };
+        struct State
+        {
+            std::unique_ptr<FILE, std::function<void(FILE*)>> file;
+            Block current;
+            Block next;
+
+            std::thread readAhead;
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool nextReady = false;
+            bool stop = false;
+
+            void fill(Block &block)
+            {
+                block.size = ::fread(block.data.data(), 1, block.data.size(), file.get());
+                block.pos = 0;
+                PROSOFT_COUNT(eBytesRead, block.size);
+            }
+            void run()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true)
+                {
+                    cv.wait(lock, [this]() { return stop || !nextReady; });
+                    if (stop)
+                        return;
+                    lock.unlock();
+                    fill(next);
+                    lock.lock();
+                    nextReady = true;
+                    cv.notify_all();
+                }
+            }
+            bool refill()
+            {
+                if (!readAhead.joinable())
+                {
+                    fill(current);
+                    return current.size > 0;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return nextReady; });
+                std::swap(current, next);
+                nextReady = false;
+                cv.notify_all();
+                return current.size > 0;
+            }
+            bool seek(uint64_t offset)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (readAhead.joinable())
+                    cv.wait(lock, [this]() { return nextReady; });
+                if (::fseeko(file.get(), static_cast<off_t>(offset), SEEK_SET) != 0)
+                    return false;
+
+                current.size = current.pos = 0;
+                nextReady = false;
+                cv.notify_all();
+                return true;
+            }
+        };
+        std::unique_ptr<State> state;
+
+    public:
+        static const size_t DEFAULT_BLOCK_SIZE = 4 << 20;
+
+        /*!
+             \param blockSize - размер блока чтения, байт
+             \param readAhead - читать следующий блок в отдельном потоке
+         */
+        explicit BufferedFile(const std::string &filename, size_t blockSize = DEFAULT_BLOCK_SIZE, bool readAhead = false)
+            : state(new State)
+        {
+            state->file = std::unique_ptr<FILE, std::function<void(FILE*)>>(::fopen(filename.c_str(), "rb"), [](FILE* f) { ::fclose(f); });
+            if (!state->file)
+                return;
+
+            blockSize = std::max<size_t>(blockSize, 1);
+            ::setvbuf(state->file.get(), nullptr, _IONBF, 0);
+            state->current.data.resize(blockSize);
+            if (readAhead)
+            {
+                state->next.data.resize(blockSize);
+                state->readAhead = std::thread(&State::run, state.get());
+            }
+        }
+        BufferedFile(const BufferedFile&) = delete;
+        BufferedFile &operator=(const BufferedFile&) = delete;
+        ~BufferedFile()
+        {
+            if (state->readAhead.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->stop = true;
+                }
+                state->cv.notify_all();
+                state->readAhead.join();
+            }
+        }
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (!dst || !state->file)
+                return false;
+
+            uint8_t *out = static_cast<uint8_t*>(dst);
+            size_t left = size * count;
+            while (left)
+            {
+                Block &block = state->current;
+                if (block.pos == block.size && !state->refill())
+                    return false;
+
+                const size_t chunk = std::min(left, block.size - block.pos);
+                memcpy(out, block.data.data() + block.pos, chunk);
+                block.pos += chunk;
+                out += chunk;
+                left -= chunk;
+            }
+            return true;
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            Block &block = state->current;
+            if (!size || count > (block.size - block.pos) / size)
+                return nullptr;
+
+            const void *res = block.data.data() + block.pos;
+            block.pos += size * count;
+            return res;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            return state->file && state->seek(offset);
+        }
+        bool isOpen() const { return !!state->file; }
+    };
+
+    /*!
+         \brief Чтение данных из участка памяти
+     */
+    class Memory : public IReader
+    {
+    protected:
+        const uint8_t *_data = nullptr;
+        size_t _size = 0;
+        mutable size_t _offset = 0;
+
+        Memory() = default;
+
+    public:
+        explicit Memory(Utils::Span<const uint8_t> data_)
+        : _data(data_.data()),
+          _size(data_.size())
+        {
+        }
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (!dst)
+                return false;
+
+            const void *src = view(size, count);
+            if (!src)
+                return false;
+
+            memcpy(dst, src, size * count);
+            return true;
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            if (!_data || !size || count > (_size - _offset) / size)
+                return nullptr;
+
+            const void *res = _data + _offset;
+            _offset += size * count;
+            return res;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            if (offset > _size)
+                return false;
+            _offset = offset;
+            return true;
+        }
+        /*!
+             \brief Все данные источника независимо от текущей позиции чтения
+         */
+        Utils::Span<const uint8_t> data() const { return Utils::Span<const uint8_t>(_data, _size); }
+    };
+
+#ifdef PROSOFT_HAS_MMAP
+    /*!
+         \brief Чтение данных из отображенного в память файла
+     */
+    class MappedFile : public Memory
+    {
+    public:
+        explicit MappedFile(const std::string &filename)
+        {
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED)
+                {
+                    ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                    _data = static_cast<const uint8_t*>(addr);
+                    _size = st.st_size;
+                }
+            }
+            ::close(fd);
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile &operator=(const MappedFile&) = delete;
+        ~MappedFile()
+        {
+            countRead();
+            if (_data)
+                ::munmap(const_cast<uint8_t*>(_data), _size);
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            const void *res = Memory::view(size, count);
+            if (!res || _offset - _counted >= COUNT_STEP)
+                countRead();
+            return res;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            countRead();
+            if (!Memory::seek(offset))
+                return false;
+            _counted = _offset;
+            return true;
+        }
+        bool isOpen() const { return !!_data; }
+
+    private:
+        /*!
+             \brief Прочитанные байты учитываются порциями, а не на каждую запись
+         */
+        static constexpr size_t COUNT_STEP = 64 * 1024;
+        mutable size_t _counted = 0;
+
+        void countRead() const
+        {
+            PROSOFT_COUNT(eBytesRead, _offset - _counted);
+            _counted = _offset;
+        }
+    };
+#endif
+
+    /*!
+         \brief Чтение контейнера сжатых блоков Compression.
+                Блоки читаются с диска по порядку, распаковываются параллельно
+                задачами общего пула с упреждением и отдаются в исходном порядке,
+                так что для остального кода это обычный поток записей
+     */
+    class CompressedFile : public IReader
+    {
+        struct Block
+        {
+            Compression::BlockHeader header;
+            std::vector<uint8_t> compressed;
+            std::vector<uint8_t> data;
+            uint64_t offset = 0;    ///< смещение начала блока в распакованных данных
+            size_t pos = 0;
+            bool ok = true;
+        };
+        enum ReadResult
+        {
+            eOk,
+            eEnd,
+            eError
+        };
+        struct State
+        {
+            std::unique_ptr<FILE, std::function<void(FILE*)>> file;
+            size_t window = 0;          ///< наибольшее количество распаковываемых и готовых блоков
+
+            std::mutex fileMutex;       ///< чтение файла и нумерация блоков
+            uint64_t nextRead = 0;
+            uint64_t nextOffset = 0;
+            bool end = false;
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::map<uint64_t, Block> ready;
+            std::vector<Block> freeBlocks;
+            uint64_t claimed = 0;       ///< количество блоков, взятых потоками распаковки
+            uint64_t nextTake = 0;      ///< номер следующего блока для читателя
+            uint64_t countBlocks = UINT64_MAX;  ///< известно после конца данных или ошибки
+            bool failed = false;
+            bool stop = false;
+
+            Block current;
+            Scheduler::Group tasks;     ///< последним полем: разрушается первым, дождавшись задач
+
+            ReadResult readBlock(Block &block)
+            {
+                const size_t got = ::fread(&block.header, 1, sizeof(block.header), file.get());
+                if (!got)
+                    return eEnd;
+                if (got != sizeof(block.header) || block.header.codec >= Compression::eCountCodecs
+                    || block.header.rawSize > Compression::MAX_BLOCK_SIZE
+                    || block.header.compressedSize > Compression::MAX_BLOCK_SIZE)
+                    return eError;
+                block.compressed.resize(block.header.compressedSize);
+                if (block.header.compressedSize
+                    && ::fread(block.compressed.data(), block.header.compressedSize, 1, file.get()) != 1)
+                    return eError;
+                PROSOFT_COUNT(eBytesRead, sizeof(block.header) + block.header.compressedSize);
+                return eOk;
+            }
+            void finish(uint64_t count, bool error)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                countBlocks = std::min(countBlocks, count);
+                failed = failed || error;
+                cv.notify_all();
+            }
+            /*!
+                 \brief Постановка задач распаковки, пока окно упреждения не заполнено. Вызывается под mutex
+             */
+            void schedule()
+            {
+                for (; !stop && countBlocks == UINT64_MAX && claimed - nextTake < window; ++claimed)
+                    tasks.run([this]() { work(); });
+            }
+            /*!
+                 \brief Задача пула: чтение и распаковка одного следующего блока
+             */
+            void work()
+            {
+                Block block;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stop || countBlocks != UINT64_MAX)
+                        return;
+                    if (!freeBlocks.empty())
+                    {
+                        block = std::move(freeBlocks.back());
+                        freeBlocks.pop_back();
+                    }
+                }
+
+                uint64_t seq = 0;
+                {
+                    std::lock_guard<std::mutex> lock(fileMutex);
+                    if (end)
+                        return;
+                    seq = nextRead;
+                    const ReadResult res = readBlock(block);
+                    if (res != eOk)
+                    {
+                        end = true;
+                        finish(seq, res == eError);
+                        return;
+                    }
+                    ++nextRead;
+                    block.offset = nextOffset;
+                    nextOffset += block.header.rawSize;
+                }
+
+                block.data.resize(block.header.rawSize);
+                block.pos = 0;
+                block.ok = Compression::decompress(static_cast<Compression::Codec>(block.header.codec),
+                                                   block.compressed, block.data.data(), block.data.size());
+
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.emplace(seq, std::move(block));
+                cv.notify_all();
+            }
+            bool next()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                Scheduler::wait(lock, cv, [this]() { return nextTake >= countBlocks || ready.count(nextTake); }, tasks.pool());
+                if (nextTake >= countBlocks)
+                    return false;
+
+                auto it = ready.find(nextTake);
+                if (freeBlocks.size() < window)
+                    freeBlocks.push_back(std::move(current));
+                current = std::move(it->second);
+                ready.erase(it);
+                ++nextTake;
+                if (!current.ok)
+                {
+                    // испорченный блок завершает данные
+                    countBlocks = nextTake - 1;
+                    failed = true;
+                    current.data.clear();
+                }
+                schedule();
+                return current.ok;
+            }
+        };
+        std::unique_ptr<State> state;
+
+    public:
+        /*!
+             \param countThreads - наибольшее количество блоков, одновременно распаковываемых
+                    задачами Scheduler::Pool::shared(), 0 - по числу потоков пула
+         */
+        explicit CompressedFile(const std::string &filename, size_t countThreads = 0)
+            : state(new State)
+        {
+            state->file = std::unique_ptr<FILE, std::function<void(FILE*)>>(::fopen(filename.c_str(), "rb"), [](FILE* f) { ::fclose(f); });
+            if (!state->file)
+                return;
+
+            char magic[sizeof(Compression::MAGIC)];
+            uint32_t fields[3];
+            if (::fread(magic, sizeof(magic), 1, state->file.get()) != 1
+                || memcmp(magic, Compression::MAGIC, sizeof(magic)) != 0
+                || ::fread(fields, sizeof(fields), 1, state->file.get()) != 1
+                || fields[0] != Compression::VERSION || fields[2] != 0)
+            {
+                state->file.reset();
+                return;
+            }
+
+            if (!countThreads)
+                countThreads = state->tasks.pool().concurrency();
+            state->window = 2 * countThreads;
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->schedule();
+        }
+        CompressedFile(const CompressedFile&) = delete;
+        CompressedFile &operator=(const CompressedFile&) = delete;
+        ~CompressedFile()
+        {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->stop = true;
+            }
+            state->tasks.wait();
+        }
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (!dst || !state->file)
+                return false;
+
+            uint8_t *out = static_cast<uint8_t*>(dst);
+            size_t left = size * count;
+            while (left)
+            {
+                Block &block = state->current;
+                if (block.pos == block.data.size() && !state->next())
+                    return false;
+
+                const size_t chunk = std::min(left, block.data.size() - block.pos);
+                memcpy(out, block.data.data() + block.pos, chunk);
+                block.pos += chunk;
+                out += chunk;
+                left -= chunk;
+            }
+            return true;
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            Block &block = state->current;
+            if (!size || count > (block.data.size() - block.pos) / size)
+                return nullptr;
+
+            const void *res = block.data.data() + block.pos;
+            block.pos += size * count;
+            return res;
+        }
+        /*!
+             \brief Переход возможен только в пределах текущего распакованного блока,
+                    этого достаточно для Format::detect()
+         */
+        bool seek(uint64_t offset) const override
+        {
+            Block &block = state->current;
+            if (!state->file || offset < block.offset || offset - block.offset > block.data.size())
+                return false;
+            block.pos = static_cast<size_t>(offset - block.offset);
+            return true;
+        }
+        bool isOpen() const { return !!state->file; }
+        /*!
+             \brief false, если данные оборвались на испорченном блоке
+         */
+        bool isOk() const
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return !state->failed;
+        }
+    };
+
+#ifdef PROSOFT_HAS_TAIL
+    /*!
+         \brief Чтение файла, который продолжает дописываться другим процессом.
+                На конце файла чтение не завершается, а ждет новых данных: через inotify,
+                где он есть, и в любом случае с опросом раз в pollInterval.
+                Каждый read() либо читает все запрошенные байты, либо ничего, так что
+                недописанная запись в конце файла просто дочитывается, когда появится.
+                Чтение завершается после stop(), по истечении idleTimeout без роста файла
+                или если файл стал короче прочитанного (перезаписан)
+     */
+    class Tail : public IReader
+    {
+        struct State
+        {
+            int fd = -1;
+            int notify = -1;        ///< inotify или -1
+            int wake[2] = { -1, -1 };  ///< канал пробуждения из stop()
+            std::vector<uint8_t> data;
+            size_t begin = 0;
+            size_t end = 0;
+            uint64_t offset = 0;    ///< смещение в файле первого непрочитанного байта
+            std::chrono::milliseconds idleTimeout;
+            std::chrono::milliseconds pollInterval;
+            std::chrono::steady_clock::time_point lastGrowth;
+            std::atomic<bool> stopped{false};
+
+            ~State()
+            {
+                for (int handle : { fd, notify, wake[0], wake[1] })
+                    if (handle >= 0)
+                        ::close(handle);
+            }
+            /*!
+                 \brief Дочитывание в буфер того, что уже есть в файле
+                 \return false при ошибке чтения
+             */
+            bool fill()
+            {
+                if (begin == end)
+                    begin = end = 0;
+                while (end < data.size())
+                {
+                    const ssize_t res = ::read(fd, data.data() + end, data.size() - end);
+                    if (res < 0 && errno == EINTR)
+                        continue;
+                    if (res < 0)
+                        return false;
+                    if (res == 0)
+                        break;
+                    end += res;
+                    lastGrowth = std::chrono::steady_clock::now();
+                    PROSOFT_COUNT(eBytesRead, res);
+                }
+                return true;
+            }
+            /*!
+                 \brief Ожидание роста файла
+                 \return false, если ждать больше не нужно
+             */
+            bool wait()
+            {
+                if (stopped.load(std::memory_order_acquire))
+                    return false;
+                if (idleTimeout.count() && std::chrono::steady_clock::now() - lastGrowth >= idleTimeout)
+                    return false;
+                struct stat st;
+                if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < offset + (end - begin))
+                    return false;
+
+                pollfd fds[2] = { { wake[0], POLLIN, 0 }, { notify, POLLIN, 0 } };
+                const int res = ::poll(fds, notify >= 0 ? 2 : 1, static_cast<int>(pollInterval.count()));
+                if (res > 0 && (fds[1].revents & POLLIN))
+                {
+                    // события нужны только как сигнал, их содержимое не важно
+                    alignas(inotify_event) char events[4096];
+                    while (::read(notify, events, sizeof(events)) > 0)
+                        ;
+                }
+                return !stopped.load(std::memory_order_acquire);
+            }
+            /*!
+                 \brief Наличие в буфере подряд size байт, с ожиданием при необходимости
+             */
+            bool ensure(size_t size, bool blocking)
+            {
+                while (end - begin < size)
+                {
+                    if (size > data.size() - begin)
+                    {
+                        memmove(data.data(), data.data() + begin, end - begin);
+                        end -= begin;
+                        begin = 0;
+                        if (size > data.size())
+                            data.resize(size);
+                    }
+                    const size_t before = end;
+                    if (!fill())
+                        return false;
+                    if (end == before && (!blocking || !wait()))
+                        return false;
+                }
+                return true;
+            }
+        };
+        std::unique_ptr<State> state;
+
+    public:
+        static const size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+        /*!
+             \param offset - смещение начала чтения, например конец последней целой записи прошлого чтения
+             \param idleTimeout - завершение чтения, если файл столько не растет. 0 - ждать до stop()
+             \param pollInterval - наибольшая пауза между проверками файла
+         */
+        explicit Tail(const std::string &filename, uint64_t offset = 0,
+                      std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(0),
+                      std::chrono::milliseconds pollInterval = std::chrono::milliseconds(100),
+                      size_t bufferSize = DEFAULT_BUFFER_SIZE)
+            : state(new State)
+        {
+            state->idleTimeout = idleTimeout;
+            state->pollInterval = std::max(pollInterval, std::chrono::milliseconds(1));
+            state->lastGrowth = std::chrono::steady_clock::now();
+            state->data.resize(std::max<size_t>(bufferSize, 1));
+            if (::pipe(state->wake) != 0)
+                return;
+            for (int handle : state->wake)
+                ::fcntl(handle, F_SETFL, ::fcntl(handle, F_GETFL) | O_NONBLOCK);
+            state->fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            if (state->fd < 0 || !seek(offset))
+                return;
+#ifdef PROSOFT_HAS_INOTIFY
+            state->notify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (state->notify >= 0 && ::inotify_add_watch(state->notify, filename.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB) < 0)
+            {
+                ::close(state->notify);
+                state->notify = -1;
+            }
+#endif
+        }
+        Tail(const Tail&) = delete;
+        Tail &operator=(const Tail&) = delete;
+
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (!dst || !isOpen() || (size && count > SIZE_MAX / size) || !state->ensure(size * count, true))
+                return false;
+            memcpy(dst, state->data.data() + state->begin, size * count);
+            state->begin += size * count;
+            state->offset += size * count;
+            return true;
+        }
+        /*!
+             \brief Данные без копирования, только если они уже прочитаны из файла: view() не ждет
+         */
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            if (!size || !isOpen() || count > SIZE_MAX / size || !state->ensure(size * count, false))
+                return nullptr;
+            const void *res = state->data.data() + state->begin;
+            state->begin += size * count;
+            state->offset += size * count;
+            return res;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            if (state->fd < 0 || ::lseek(state->fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+                return false;
+            state->begin = state->end = 0;
+            state->offset = offset;
+            return true;
+        }
+        size_t available() const override
+        {
+            if (!isOpen() || (state->begin == state->end && !state->fill()))
+                return 0;
+            return state->end - state->begin;
+        }
+        /*!
+             \brief Смещение в файле следующего непрочитанного байта
+         */
+        uint64_t offset() const { return state->offset; }
+        /*!
+             \brief Завершение ожидания: уже записанные данные дочитываются, после чего read() возвращает false.
+                    Может вызываться из любого потока
+         */
+        void stop()
+        {
+            state->stopped.store(true, std::memory_order_release);
+            const char signal = 0;
+            if (::write(state->wake[1], &signal, 1) < 0)
+                return;     // канал полон, значит пробуждение уже ожидает
+        }
+        bool isOpen() const { return state->fd >= 0; }
+    };
+#endif
+
+#ifdef PROSOFT_HAS_URING
+    /*!
+         \brief Чтение файла через io_uring: до depth крупных чтений одновременно стоят в очереди ядра,
+                готовые блоки отдаются по порядку без ожидания каждого чтения.
+                С eDirect файл читается с O_DIRECT в обход страничного кэша, с eRegisteredBuffers
+                буферы регистрируются в ядре один раз, и чтения не отображают их заново.
+                Недоступный режим молча отключается. Если кольцо не создается (старое ядро, запрет
+                в контейнере), чтение идет через BufferedFile с упреждающим чтением
+     */
+    class UringFile : public IReader
+    {
+    public:
+        enum Flags : unsigned
+        {
+            eDirect = 1,
+            eRegisteredBuffers = 2
+        };
+        static const size_t DEFAULT_BLOCK_SIZE = 1 << 20;
+        static const size_t DEFAULT_DEPTH = 8;
+
+    private:
+        static const size_t DIRECT_ALIGNMENT = 4096;
+
+        struct Slot
+        {
+            size_t size = 0;        ///< ожидаемый размер блока
+            size_t filled = 0;
+            bool done = false;
+            bool failed = false;
+        };
+        struct State
+        {
+            int fd = -1;
+            int ring = -1;
+            bool direct = false;
+            bool fixed = false;     ///< буферы зарегистрированы, чтения IORING_OP_READ_FIXED
+
+            void *sqMap = MAP_FAILED;
+            size_t sqMapSize = 0;
+            void *cqMap = MAP_FAILED;
+            size_t cqMapSize = 0;
+            io_uring_sqe *sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+            size_t sqesSize = 0;
+            unsigned *sqTail = nullptr;
+            unsigned *sqMask = nullptr;
+            unsigned *sqArray = nullptr;
+            unsigned *cqHead = nullptr;
+            unsigned *cqTail = nullptr;
+            unsigned *cqMask = nullptr;
+            io_uring_cqe *cqes = nullptr;
+
+            uint8_t *buffers = static_cast<uint8_t*>(MAP_FAILED);
+            size_t blockSize = 0;
+            std::vector<Slot> slots;    ///< блок k читается в слот k % slots.size()
+            uint64_t fileSize = 0;
+            uint64_t countBlocks = 0;
+            uint64_t nextSubmit = 0;    ///< следующий блок для постановки в очередь
+            uint64_t nextTake = 0;      ///< следующий блок для читателя
+            uint64_t first = 0;         ///< первый блок, слот которого еще занят
+            size_t inFlight = 0;
+            unsigned unsubmitted = 0;
+            bool failed = false;
+
+            const uint8_t *data = nullptr;  ///< текущий блок
+            size_t size = 0;
+            size_t pos = 0;
+            size_t skip = 0;            ///< пропуск в начале следующего блока после seek()
+
+            std::unique_ptr<BufferedFile> fallback;
+
+            ~State()
+            {
+                drain();
+                if (buffers != MAP_FAILED)
+                    ::munmap(buffers, blockSize * slots.size());
+                if (sqes != MAP_FAILED)
+                    ::munmap(sqes, sqesSize);
+                if (cqMap != MAP_FAILED && cqMap != sqMap)
+                    ::munmap(cqMap, cqMapSize);
+                if (sqMap != MAP_FAILED)
+                    ::munmap(sqMap, sqMapSize);
+                for (int handle : { ring, fd })
+                    if (handle >= 0)
+                        ::close(handle);
+            }
+
+            static int enter(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags)
+            {
+                return static_cast<int>(::syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+            }
+            bool setup(size_t depth)
+            {
+                io_uring_params params;
+                memset(&params, 0, sizeof(params));
+                ring = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+                if (ring < 0)
+                    return false;
+
+                sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+                if (single)
+                    sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+                sqMap = ::mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+                if (sqMap == MAP_FAILED)
+                    return false;
+                cqMap = single ? sqMap : ::mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+                if (cqMap == MAP_FAILED)
+                    return false;
+                sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+                sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES));
+                if (sqes == MAP_FAILED)
+                    return false;
+
+                uint8_t *sq = static_cast<uint8_t*>(sqMap);
+                uint8_t *cq = static_cast<uint8_t*>(cqMap);
+                sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+                sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+                sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+                cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+                cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+                cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+                cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+                return true;
+            }
+            void registerBuffers()
+            {
+                std::vector<iovec> iovs(slots.size());
+                for (size_t i = 0; i < slots.size(); ++i)
+                    iovs[i] = { buffers + i * blockSize, blockSize };
+                fixed = ::syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iovs.data(), static_cast<unsigned>(iovs.size())) == 0;
+            }
+
+            /*!
+                 \brief Постановка чтения остатка блока в очередь отправки, без системного вызова
+             */
+            void queue(uint64_t block)
+            {
+                const size_t index = block % slots.size();
+                const Slot &slot = slots[index];
+                size_t length = slot.size - slot.filled;
+                if (direct)
+                    length = std::min(blockSize - slot.filled, (length + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT);
+
+                const unsigned tail = *sqTail;
+                const unsigned pos = tail & *sqMask;
+                io_uring_sqe &sqe = sqes[pos];
+                memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                sqe.fd = fd;
+                sqe.off = block * blockSize + slot.filled;
+                sqe.addr = reinterpret_cast<uintptr_t>(buffers + index * blockSize + slot.filled);
+                sqe.len = static_cast<uint32_t>(length);
+                sqe.buf_index = static_cast<uint16_t>(fixed ? index : 0);
+                sqe.user_data = block;
+                sqArray[pos] = pos;
+                __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+                ++unsubmitted;
+                ++inFlight;
+            }
+            /*!
+                 \brief Разбор завершенных чтений. Короткое чтение дочитывается новым запросом,
+                        в режиме direct - с выровненного начала, повторяя прочитанный невыровненный хвост
+             */
+            void reap()
+            {
+                unsigned head = *cqHead;
+                for (; head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); ++head)
+                {
+                    const io_uring_cqe &cqe = cqes[head & *cqMask];
+                    const uint64_t block = cqe.user_data;
+                    Slot &slot = slots[block % slots.size()];
+                    --inFlight;
+                    if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+                    {
+                        queue(block);
+                        continue;
+                    }
+                    if (cqe.res <= 0)
+                    {
+                        slot.failed = slot.done = true;
+                        continue;
+                    }
+                    const size_t before = slot.filled;
+                    slot.filled = std::min(slot.size, slot.filled + cqe.res);
+                    PROSOFT_COUNT(eBytesRead, cqe.res);
+                    if (slot.filled == slot.size)
+                    {
+                        slot.done = true;
+                        continue;
+                    }
+                    // O_DIRECT принимает только выровненные смещение и адрес: хвост дочитывается заново
+                    if (direct)
+                        slot.filled = slot.filled / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+                    if (slot.filled == before)
+                        slot.failed = slot.done = true;
+                    else
+                        queue(block);
+                }
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+            /*!
+                 \brief Отправка накопленных запросов и, при wait, ожидание хотя бы одного завершения
+             */
+            bool enter(bool wait)
+            {
+                while (true)
+                {
+                    const int res = enter(ring, unsubmitted, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+                    if (res >= 0)
+                    {
+                        unsubmitted -= std::min<unsigned>(res, unsubmitted);
+                        if (!wait || !unsubmitted)
+                            break;
+                    }
+                    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                        return false;
+                }
+                reap();
+                return true;
+            }
+            /*!
+                 \brief Ожидание завершения всех чтений, после него буферы свободны
+             */
+            void drain()
+            {
+                while (inFlight && enter(true))
+                    ;
+            }
+            void submit()
+            {
+                for (; nextSubmit < countBlocks && nextSubmit - first < slots.size(); ++nextSubmit)
+                {
+                    Slot &slot = slots[nextSubmit % slots.size()];
+                    slot = Slot();
+                    slot.size = static_cast<size_t>(std::min<uint64_t>(blockSize, fileSize - nextSubmit * blockSize));
+                    queue(nextSubmit);
+                }
+                if (unsubmitted && !enter(false))
+                    failed = true;
+            }
+            /*!
+                 \brief Освобождение текущего блока и переход к следующему
+             */
+            bool next()
+            {
+                first = nextTake;
+                submit();
+                if (failed || nextTake >= countBlocks)
+                    return false;
+
+                Slot &slot = slots[nextTake % slots.size()];
+                while (!slot.done)
+                {
+                    if (!enter(true))
+                    {
+                        failed = true;
+                        return false;
+                    }
+                }
+                if (slot.failed)
+                {
+                    // ошибка чтения завершает данные
+                    failed = true;
+                    return false;
+                }
+                data = buffers + (nextTake % slots.size()) * blockSize;
+                size = slot.filled;
+                pos = std::min(skip, size);
+                skip = 0;
+                ++nextTake;
+                return pos < size;
+            }
+        };
+        std::unique_ptr<State> state;
+
+    public:
+        /*!
+             \param blockSize - размер одного чтения, байт. С eDirect округляется вверх до 4096
+             \param depth - количество одновременных чтений
+             \param flags - сочетание Flags
+         */
+        explicit UringFile(const std::string &filename, size_t blockSize = DEFAULT_BLOCK_SIZE,
+                           size_t depth = DEFAULT_DEPTH, unsigned flags = 0)
+            : state(new State)
+        {
+            blockSize = std::max<size_t>(blockSize, 1);
+            depth = std::min<size_t>(std::max<size_t>(depth, 1), 4096);
+            if (flags & eDirect)
+            {
+                state->fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+                state->direct = state->fd >= 0;
+                blockSize = (blockSize + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+            }
+            if (state->fd < 0)
+                state->fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat st;
+            if (state->fd < 0 || ::fstat(state->fd, &st) != 0)
+                return;
+
+            state->blockSize = blockSize;
+            state->slots.resize(depth);
+            void *buffers = ::mmap(nullptr, blockSize * depth, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buffers == MAP_FAILED || !state->setup(depth))
+            {
+                if (buffers != MAP_FAILED)
+                    ::munmap(buffers, blockSize * depth);
+                state.reset(new State);
+                state->fallback.reset(new BufferedFile(filename, blockSize, true));
+                return;
+            }
+            state->buffers = static_cast<uint8_t*>(buffers);
+            if (flags & eRegisteredBuffers)
+                state->registerBuffers();
+            state->fileSize = st.st_size;
+            state->countBlocks = (state->fileSize + blockSize - 1) / blockSize;
+            state->submit();
+        }
+        UringFile(const UringFile&) = delete;
+        UringFile &operator=(const UringFile&) = delete;
+
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (state->fallback)
+                return state->fallback->read(dst, size, count);
+            if (!dst || !isOpen())
+                return false;
+
+            uint8_t *out = static_cast<uint8_t*>(dst);
+            size_t left = size * count;
+            while (left)
+            {
+                if (state->pos == state->size && !state->next())
+                    return false;
+
+                const size_t chunk = std::min(left, state->size - state->pos);
+                memcpy(out, state->data + state->pos, chunk);
+                state->pos += chunk;
+                out += chunk;
+                left -= chunk;
+            }
+            return true;
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            if (state->fallback)
+                return state->fallback->view(size, count);
+            if (!size || !isOpen() || (state->pos == state->size && !state->next()))
+                return nullptr;
+            if (count > (state->size - state->pos) / size)
+                return nullptr;
+
+            const void *res = state->data + state->pos;
+            state->pos += size * count;
+            return res;
+        }
+        bool seek(uint64_t offset) const override
+        {
+            if (state->fallback)
+                return state->fallback->seek(offset);
+            if (!isOpen() || offset > state->fileSize)
+                return false;
+
+            // буферы текущих чтений освобождаются только после их завершения
+            state->drain();
+            state->nextSubmit = state->nextTake = state->first = offset / state->blockSize;
+            state->skip = static_cast<size_t>(offset % state->blockSize);
+            state->data = nullptr;
+            state->size = state->pos = 0;
+            state->failed = false;
+            state->submit();
+            return true;
+        }
+        bool isOpen() const { return state->fallback ? state->fallback->isOpen() : state->fd >= 0; }
+        /*!
+             \brief Идет ли чтение через io_uring, а не через запасной BufferedFile
+         */
+        bool isAsync() const { return !state->fallback && state->ring >= 0; }
+        bool isDirect() const { return isAsync() && state->direct; }
+        bool hasRegisteredBuffers() const { return isAsync() && state->fixed; }
+        /*!
+             \brief false, если чтение оборвалось на ошибке ввода-вывода
+         */
+        bool isOk() const { return !state->failed; }
+    };
+#endif
+
+    /*!
+         \brief Открытие файла данных подходящим читателем: контейнер сжатых блоков
+                распаковывается параллельно, обычный файл по возможности отображается в память
+     */
+    inline std::unique_ptr<IReader> open(const std::string &filename)
+    {
+        if (Compression::isContainer(filename))
+            return std::unique_ptr<IReader>(new CompressedFile(filename));
+#ifdef PROSOFT_HAS_MMAP
+        return std::unique_ptr<IReader>(new MappedFile(filename));
+#else
+        return std::unique_ptr<IReader>(new File(filename));
+#endif
+    }
+    /*!
+         \brief Открытие файла данных для чтения с быстрого накопителя: через io_uring, где он есть,
+                иначе через BufferedFile с упреждающим чтением. Контейнер сжатых блоков - как в open()
+         \param direct - читать в обход страничного кэша, если файловая система это позволяет
+     */
+    inline std::unique_ptr<IReader> openAsync(const std::string &filename, bool direct = false)
+    {
+        if (Compression::isContainer(filename))
+            return std::unique_ptr<IReader>(new CompressedFile(filename));
+#ifdef PROSOFT_HAS_URING
+        const unsigned flags = UringFile::eRegisteredBuffers | (direct ? unsigned(UringFile::eDirect) : 0u);
+        return std::unique_ptr<IReader>(new UringFile(filename, UringFile::DEFAULT_BLOCK_SIZE, UringFile::DEFAULT_DEPTH, flags));
+#else
+        (void)direct;
+        return std::unique_ptr<IReader>(new BufferedFile(filename, BufferedFile::DEFAULT_BLOCK_SIZE, true));
+#endif
+    }
+}
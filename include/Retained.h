@@ -0,0 +1,359 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Culling.h"
+#include "Drawer.h"
+#include "Feature.h"
+#include "Figure.h"
+#include "Spatial.h"
+#include "Utils.h"
+
+namespace Retained
+{
+    /*!
+         \brief Сцена, хранящая декодированные фигуры между кадрами.
+                Изменения (новые, обновленные и удаленные записи) отмечают прямоугольники
+                старых и новых границ фигур как грязные, и redraw() отдает IDrawer только
+                фигуры, пересекающие эти области, вместо перерисовки всей сцены.
+                Фигура определяется порядковым номером записи в источнике.
+                Фигуры в грязных областях ищутся по R-дереву, построенному при одной из прошлых
+                перерисовок, и по списку фигур, изменившихся или переехавших после его построения
+     */
+    class Scene
+    {
+    public:
+        /*!
+             \brief Наибольшее количество грязных прямоугольников. Новый прямоугольник сверх него
+                    объединяется с тем, чья площадь от этого растет меньше всего
+         */
+        static constexpr size_t MAX_DIRTY_RECTS = 64;
+
+    private:
+        struct Location
+        {
+            Figure::Type type;
+            size_t index;
+        };
+
+        FeatureBatch _batch;
+        std::unordered_map<uint64_t, Location> locations;
+        std::vector<Utils::Rect> dirtyRects;
+        bool coalesced = true;
+        Spatial::RTree tree;
+        std::vector<Location> changed;  ///< места фигур, которые дерево может не знать или знать с прежними границами
+
+        static double area(const Utils::Rect &rect) { return rect.width() * rect.height(); }
+
+        Utils::Rect bounds(const Location &location) const
+        {
+            if (location.type == Figure::eCircle)
+                return Culling::circleBounds(_batch.circles, location.index);
+            return Culling::poligonBounds(group(location.type), location.index);
+        }
+        template <typename Batch>
+        static auto &group(Batch &batch, Figure::Type type) { return type == Figure::eTriangle ? batch.triangles : batch.squares; }
+        FeatureBatch::Poligons &group(Figure::Type type) { return group(_batch, type); }
+        const FeatureBatch::Poligons &group(Figure::Type type) const { return group(_batch, type); }
+
+        /*!
+             \brief Удаление с переносом последней фигуры группы на освободившееся место.
+                    Запись locations удаляемой фигуры вызывающий убирает или заменяет сам
+         */
+        void erase(const Location &location)
+        {
+            if (location.type == Figure::eCircle)
+            {
+                FeatureBatch::Circles &circles = _batch.circles;
+                const size_t last = circles.size() - 1;
+                if (location.index != last)
+                {
+                    circles.centerX[location.index] = circles.centerX[last];
+                    circles.centerY[location.index] = circles.centerY[last];
+                    circles.radius[location.index] = circles.radius[last];
+                    circles.ids[location.index] = circles.ids[last];
+                    locations[circles.ids[last]].index = location.index;
+                    changed.push_back(location);
+                }
+                circles.centerX.pop_back();
+                circles.centerY.pop_back();
+                circles.radius.pop_back();
+                circles.ids.pop_back();
+                return;
+            }
+            FeatureBatch::Poligons &poligons = group(location.type);
+            const size_t last = poligons.size() - 1;
+            if (location.index != last)
+            {
+                std::copy_n(poligons.points.begin() + last * poligons.countParams, poligons.countParams,
+                            poligons.points.begin() + location.index * poligons.countParams);
+                poligons.ids[location.index] = poligons.ids[last];
+                locations[poligons.ids[last]].index = location.index;
+                changed.push_back(location);
+            }
+            poligons.points.resize(last * poligons.countParams);
+            poligons.offsets.pop_back();
+            poligons.ids.pop_back();
+        }
+        /*!
+             \brief Замена параметров фигуры того же типа на месте
+         */
+        void assign(const Location &location, const FeatureBatch &changes, const Location &source)
+        {
+            changed.push_back(location);
+            if (location.type == Figure::eCircle)
+            {
+                _batch.circles.centerX[location.index] = changes.circles.centerX[source.index];
+                _batch.circles.centerY[location.index] = changes.circles.centerY[source.index];
+                _batch.circles.radius[location.index] = changes.circles.radius[source.index];
+                return;
+            }
+            const Utils::Span<const double> params = group(changes, source.type).poligon(source.index);
+            FeatureBatch::Poligons &poligons = group(location.type);
+            std::copy(params.begin(), params.end(), poligons.points.begin() + location.index * poligons.countParams);
+        }
+        /*!
+             \return false, если смещения группы вышли бы за uint32_t. Тогда сцена не меняется
+         */
+        bool push(const FeatureBatch &changes, const Location &source, uint64_t id, Location &res)
+        {
+            if (source.type == Figure::eCircle)
+            {
+                _batch.circles.centerX.push_back(changes.circles.centerX[source.index]);
+                _batch.circles.centerY.push_back(changes.circles.centerY[source.index]);
+                _batch.circles.radius.push_back(changes.circles.radius[source.index]);
+                _batch.circles.ids.push_back(id);
+                changed.push_back({ source.type, _batch.circles.size() - 1 });
+                res = changed.back();
+                return true;
+            }
+            const Utils::Span<const double> params = group(changes, source.type).poligon(source.index);
+            FeatureBatch::Poligons &poligons = group(source.type);
+            if (!FeatureBatch::fits(poligons.points.size(), params.size()))
+                return false;
+            poligons.points.insert(poligons.points.end(), params.begin(), params.end());
+            poligons.offsets.push_back(static_cast<uint32_t>(poligons.points.size()));
+            poligons.ids.push_back(id);
+            changed.push_back({ source.type, poligons.size() - 1 });
+            res = changed.back();
+            return true;
+        }
+        /*!
+             \return false, если фигура не поместилась в сцену. Прежняя фигура с ее номером тогда удаляется
+         */
+        bool change(const FeatureBatch &changes, const Location &source, uint64_t id)
+        {
+            const auto it = locations.find(id);
+            if (it == locations.end())
+            {
+                Location location;
+                if (!push(changes, source, id, location))
+                    return false;
+                locations.emplace(id, location);
+                markDirty(bounds(location));
+                return true;
+            }
+
+            const Utils::Rect before = bounds(it->second);
+            if (it->second.type == source.type)
+            {
+                assign(it->second, changes, source);
+            }
+            else
+            {
+                const Location old = it->second;
+                Location location;
+                if (!push(changes, source, id, location))
+                {
+                    remove(id);
+                    return false;
+                }
+                it->second = location;
+                erase(old);
+            }
+            // старое и новое место одной фигуры обычно пересекаются и перерисовываются одной областью
+            Utils::Rect after = bounds(locations[id]);
+            if (after.intersects(before))
+            {
+                after.unite(before);
+            }
+            else
+            {
+                markDirty(before);
+            }
+            markDirty(after);
+            return true;
+        }
+        /*!
+             \brief Объединение пересекающихся прямоугольников
+         */
+        void coalesce()
+        {
+            for (bool merged = true; merged;)
+            {
+                merged = false;
+                for (size_t i = 0; i < dirtyRects.size(); ++i)
+                {
+                    for (size_t k = i + 1; k < dirtyRects.size();)
+                    {
+                        if (!dirtyRects[i].intersects(dirtyRects[k]))
+                        {
+                            ++k;
+                            continue;
+                        }
+                        dirtyRects[i].unite(dirtyRects[k]);
+                        dirtyRects[k] = dirtyRects.back();
+                        dirtyRects.pop_back();
+                        merged = true;
+                    }
+                }
+            }
+            coalesced = true;
+        }
+
+    public:
+        /*!
+             \brief Фигуры сцены. Изменять их следует только через apply() и remove()
+         */
+        const FeatureBatch &batch() const { return _batch; }
+        size_t size() const { return _batch.size(); }
+        bool contains(uint64_t id) const { return locations.count(id) != 0; }
+
+        /*!
+             \brief Добавление фигур пакета: фигура с уже известным номером записи
+                    заменяет прежнюю, в том числе фигурой другого типа.
+                    Фигуры changes.others сцена не хранит: прежние фигуры с их номерами удаляются
+             \return false, если какие-то фигуры не поместились: смещения многоугольников хранятся в uint32_t
+         */
+        bool apply(const FeatureBatch &changes)
+        {
+            bool res = true;
+            for (size_t i = 0; i < changes.circles.size(); ++i)
+                res = change(changes, { Figure::eCircle, i }, changes.circles.ids[i]) && res;
+            for (size_t i = 0; i < changes.triangles.size(); ++i)
+                res = change(changes, { Figure::eTriangle, i }, changes.triangles.ids[i]) && res;
+            for (size_t i = 0; i < changes.squares.size(); ++i)
+                res = change(changes, { Figure::eSquare, i }, changes.squares.ids[i]) && res;
+            for (const FeatureBatch::Group &other : changes.others)
+                for (uint64_t id : other.ids)
+                    remove(id);
+            return res;
+        }
+        /*!
+             \return false, если фигуры с таким номером нет
+         */
+        bool remove(uint64_t id)
+        {
+            const auto it = locations.find(id);
+            if (it == locations.end())
+                return false;
+            const Location location = it->second;
+            markDirty(bounds(location));
+            locations.erase(it);
+            erase(location);
+            return true;
+        }
+        void clear()
+        {
+            for (size_t i = 0; i < _batch.circles.size(); ++i)
+                markDirty(Culling::circleBounds(_batch.circles, i));
+            for (const FeatureBatch::Poligons *poligons : { &_batch.triangles, &_batch.squares })
+                for (size_t i = 0; i < poligons->size(); ++i)
+                    markDirty(Culling::poligonBounds(*poligons, i));
+            _batch.clear();
+            locations.clear();
+            changed.clear();
+            tree.build(_batch);
+        }
+
+        /*!
+             \brief Отметка области для перерисовки, например после смены фона
+         */
+        void markDirty(const Utils::Rect &rect)
+        {
+            coalesced = false;
+            if (dirtyRects.size() < MAX_DIRTY_RECTS)
+            {
+                dirtyRects.push_back(rect);
+                return;
+            }
+            size_t best = 0;
+            double bestGrowth = 0;
+            for (size_t i = 0; i < dirtyRects.size(); ++i)
+            {
+                Utils::Rect united = dirtyRects[i];
+                united.unite(rect);
+                const double growth = area(united) - area(dirtyRects[i]);
+                if (!i || growth < bestGrowth)
+                {
+                    best = i;
+                    bestGrowth = growth;
+                }
+            }
+            dirtyRects[best].unite(rect);
+        }
+        /*!
+             \brief Непересекающиеся области, изменившиеся с последней перерисовки.
+                    Их очистка до redraw() - забота вызывающего
+         */
+        const std::vector<Utils::Rect> &dirty()
+        {
+            if (!coalesced)
+                coalesce();
+            return dirtyRects;
+        }
+        bool isDirty() const { return !dirtyRects.empty(); }
+
+        /*!
+             \brief Отрисовка фигур, пересекающих грязные области, одним пакетом;
+                    каждая фигура рисуется один раз, даже если задевает несколько областей.
+                    Когда изменилась заметная доля сцены, дерево строится заново
+             \return количество отрисованных фигур
+         */
+        size_t redraw(const Drawer::IDrawer &drawer)
+        {
+            if (dirtyRects.empty())
+                return 0;
+            if (changed.size() > std::max<size_t>(_batch.size() / 64, 1024))
+            {
+                tree.build(_batch);
+                changed.clear();
+            }
+
+            FeatureBatch::Selection affected;
+            Utils::Bitmap *groups[Figure::eCountTypes] = { &affected.circles, &affected.triangles, &affected.squares };
+            const size_t groupSizes[Figure::eCountTypes] = { _batch.circles.size(), _batch.triangles.size(), _batch.squares.size() };
+            for (size_t type = 0; type < Figure::eCountTypes; ++type)
+                groups[type]->assign(groupSizes[type], false);
+            // место могло опустеть или достаться другой фигуре, поэтому проверяются текущие границы
+            auto mark = [&](const Location &location, const Utils::Rect &rect)
+            {
+                if (location.index < groupSizes[location.type] && bounds(location).intersects(rect))
+                    groups[location.type]->set(location.index);
+            };
+            for (const Utils::Rect &rect : dirty())
+            {
+                tree.query(rect, [&](Figure::Type type, size_t index) { mark({ type, index }, rect); });
+                for (const Location &location : changed)
+                    mark(location, rect);
+            }
+            dirtyRects.clear();
+
+            FeatureBatch res;
+            res.append(_batch, affected);
+            res.draw(drawer);
+            return res.size();
+        }
+        /*!
+             \brief Полная перерисовка сцены, сбрасывает грязные области
+         */
+        void draw(const Drawer::IDrawer &drawer)
+        {
+            dirtyRects.clear();
+            _batch.draw(drawer);
+        }
+    };
+}
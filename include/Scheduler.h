@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Scheduler
+{
+    /*!
+         \brief Общий пул потоков с перехватом работы. У каждого потока своя очередь:
+                задачи, поставленные из потока пула, попадают в его очередь и берутся с конца,
+                а свободные потоки забирают задачи с начала чужих очередей.
+                Задачи не должны ждать друг друга иначе, чем через Group::wait() и Scheduler::wait():
+                ожидающий поток сам выполняет задачи пула, поэтому вложенные ожидания
+                не блокируют пул даже с одним потоком
+     */
+    class Pool
+    {
+    public:
+        using Task = std::function<void()>;
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+        struct Current
+        {
+            const Pool *pool = nullptr;
+            size_t index = 0;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<size_t> pending{0};
+        std::atomic<size_t> sleeping{0};
+        std::atomic<size_t> nextQueue{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping = false;
+
+        /*!
+             \brief Пул и номер очереди текущего потока, если он принадлежит пулу
+         */
+        static Current &current()
+        {
+            thread_local Current res;
+            return res;
+        }
+        /*!
+             \brief Задача из своей очереди с конца или из чужих с начала
+         */
+        bool take(size_t self, Task &task)
+        {
+            if (!pending.load(std::memory_order_acquire))
+                return false;
+            for (size_t i = 0; i < queues.size(); ++i)
+            {
+                const bool own = !i;
+                Queue &queue = *queues[(self + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty())
+                    continue;
+                if (own)
+                {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else
+                {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                pending.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+        void work(size_t index)
+        {
+            current() = { this, index };
+            Task task;
+            while (true)
+            {
+                if (take(index, task))
+                {
+                    task();
+                    task = nullptr;
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.fetch_add(1);
+                cv.wait(lock, [this]() { return stopping || pending.load() != 0; });
+                sleeping.fetch_sub(1);
+                if (stopping && !pending.load())
+                    return;
+            }
+        }
+
+    public:
+        /*!
+             \brief Количество потоков по умолчанию: PROSOFT_THREADS или число ядер
+         */
+        static size_t defaultThreads()
+        {
+            if (const char *value = std::getenv("PROSOFT_THREADS"))
+                if (const long long count = std::atoll(value); count > 0)
+                    return static_cast<size_t>(count);
+            return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        /*!
+             \brief Пул, в который ставят задачи все стадии, если не указан другой.
+                    Создается при первом обращении с defaultThreads() потоками и не разрушается,
+                    чтобы остановка его потоков не зависела от порядка разрушения статических объектов
+         */
+        static Pool &shared()
+        {
+            static Pool *pool = new Pool;
+            return *pool;
+        }
+
+        /*!
+             \param countThreads - количество потоков, 0 - defaultThreads()
+         */
+        explicit Pool(size_t countThreads = 0)
+        {
+            if (!countThreads)
+                countThreads = defaultThreads();
+            for (size_t i = 0; i < countThreads; ++i)
+                queues.emplace_back(new Queue);
+            for (size_t i = 0; i < countThreads; ++i)
+                threads.emplace_back(&Pool::work, this, i);
+        }
+        Pool(const Pool&) = delete;
+        Pool &operator=(const Pool&) = delete;
+        /*!
+             \brief Уже поставленные задачи выполняются до остановки потоков
+         */
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto &thread : threads)
+                thread.join();
+        }
+
+        size_t size() const { return threads.size(); }
+        /*!
+             \brief Количество задач, которые может выполнять одновременно вызывающий вместе с пулом
+         */
+        size_t concurrency() const { return size() + (current().pool == this ? 0 : 1); }
+
+        void submit(Task task)
+        {
+            const Current &self = current();
+            const size_t index = self.pool == this ? self.index : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+            // счетчик растет раньше появления задачи, чтобы не уходить ниже нуля при перехвате
+            pending.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(std::move(task));
+            }
+            // пара pending/sleeping не дает потерять пробуждение без блокировки на каждую задачу
+            if (sleeping.load())
+            {
+                { std::lock_guard<std::mutex> lock(mutex); }
+                cv.notify_one();
+            }
+        }
+        /*!
+             \brief Выполнение одной задачи пула в вызывающем потоке
+             \return false, если задач нет
+         */
+        bool runOne()
+        {
+            const Current &self = current();
+            Task task;
+            if (!take(self.pool == this ? self.index : 0, task))
+                return false;
+            task();
+            return true;
+        }
+    };
+
+    /*!
+         \brief Ожидание условия под lock с выполнением задач пула, пока условие ложно.
+                Заменяет cv.wait(lock, ready) там, где условие выполняют задачи того же пула
+     */
+    template <typename Ready>
+    void wait(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, Ready &&ready, Pool &pool = Pool::shared())
+    {
+        while (!ready())
+        {
+            lock.unlock();
+            const bool ran = pool.runOne();
+            lock.lock();
+            // пока задач нет, ждать с таймаутом: новые задачи пула не будят этот cv
+            if (!ran && !ready())
+                cv.wait_for(lock, std::chrono::milliseconds(1), ready);
+        }
+    }
+
+    /*!
+         \brief Группа задач пула с ожиданием всех. Разрушение группы дожидается ее задач
+     */
+    class Group
+    {
+        Pool &_pool;
+        size_t count = 0;
+        std::mutex mutex;
+        std::condition_variable cv;
+
+    public:
+        explicit Group(Pool &pool = Pool::shared())
+            : _pool(pool)
+        {
+        }
+        Group(const Group&) = delete;
+        Group &operator=(const Group&) = delete;
+        ~Group() { wait(); }
+
+        Pool &pool() const { return _pool; }
+
+        template <typename Task>
+        void run(Task &&task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++count;
+            }
+            _pool.submit([this, task = std::forward<Task>(task)]() mutable
+            {
+                task();
+                // уведомление под блокировкой: после нее задача группу больше не трогает
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!--count)
+                    cv.notify_all();
+            });
+        }
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            Scheduler::wait(lock, cv, [this]() { return !count; }, _pool);
+        }
+    };
+
+    /*!
+         \brief Вызов task(i) для i из [0, count) не более чем в countThreads потоках,
+                включая вызывающий. Индексы раздаются по одному, так что неравные по времени
+                вызовы распределяются сами
+         \param countThreads - 0 - Pool::concurrency()
+     */
+    template <typename Task>
+    void parallelFor(size_t count, Task &&task, size_t countThreads = 0, Pool &pool = Pool::shared())
+    {
+        if (!countThreads)
+            countThreads = pool.concurrency();
+        countThreads = std::min(countThreads, count);
+        if (countThreads <= 1)
+        {
+            for (size_t i = 0; i < count; ++i)
+                task(i);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        auto worker = [&]()
+        {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+                task(i);
+        };
+        Group group(pool);
+        for (size_t i = 1; i < countThreads; ++i)
+            group.run(worker);
+        worker();
+        group.wait();
+    }
+}
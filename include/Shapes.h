@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Drawer.h"
+#include "Figure.h"
+#include "Utils.h"
+
+/*!
+     \brief Фигуры, которые регистрируются в Figure::Factory во время выполнения.
+            Своих колонок в FeatureBatch у них нет: пакет хранит их параметры по группе на тип
+            и рисует через Figure::Figure::drawBatch(). Файлы с ними пишутся с префиксом
+            длины записи, чтобы читатель без этих типов пропускал их записи
+ */
+namespace Shapes
+{
+    /*!
+         \brief Номера типов: встроенным типам оставлен запас
+     */
+    constexpr Figure::Type ELLIPSE_TYPE = static_cast<Figure::Type>(16);
+    constexpr Figure::Type POLYLINE_TYPE = static_cast<Figure::Type>(17);
+
+    /*!
+         \brief Эллипс с осями вдоль осей координат: центр и две полуоси.
+                IDrawer не умеет рисовать эллипсы, поэтому он рисуется вписанным многоугольником
+     */
+    class Ellipse : public Figure::Figure
+    {
+        static constexpr double PI = 3.14159265358979323846;
+        static const size_t SEGMENTS = 32;  ///< вершин многоугольника эллипса
+        using UnitCircle = std::array<double, 2 * SEGMENTS>;
+
+        /*!
+             \brief Вершины единичной окружности: cos, sin попеременно, считаются один раз
+         */
+        static const UnitCircle &unitCircle()
+        {
+            static const UnitCircle res = []()
+            {
+                UnitCircle points;
+                for (size_t i = 0; i < SEGMENTS; ++i)
+                {
+                    points[2 * i] = std::cos(2 * PI * i / SEGMENTS);
+                    points[2 * i + 1] = std::sin(2 * PI * i / SEGMENTS);
+                }
+                return points;
+            }();
+            return res;
+        }
+        /*!
+             \brief Дописывание вершин многоугольника эллипса в конец points
+         */
+        static void tessellate(const double *params, std::vector<double> &points)
+        {
+            const UnitCircle &unit = unitCircle();
+            const size_t pos = points.size();
+            points.resize(pos + unit.size());
+            for (size_t i = 0; i < unit.size(); i += 2)
+            {
+                points[pos + i] = params[0] + params[2] * unit[i];
+                points[pos + i + 1] = params[1] + params[3] * unit[i + 1];
+            }
+        }
+
+    public:
+        Ellipse() : Figure(TYPE, COUNT_PARAMS, LENGTH_PARAMS) {}
+        virtual ~Ellipse() = default;
+        void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const override
+        {
+            if (params.size() < COUNT_PARAMS)
+                return;
+            std::vector<double> points;
+            tessellate(params.data(), points);
+            drawer.drawPoligon(points);
+        }
+        /*!
+             \brief Все эллипсы пакета уходят одним вызовом IDrawer::drawPoligons()
+         */
+        void drawBatch(const Drawer::IDrawer &drawer, Utils::Span<const double> params, Utils::Span<const uint32_t> offsets) const override
+        {
+            std::vector<double> points;
+            std::vector<uint32_t> pointOffsets{0};
+            points.reserve(2 * SEGMENTS * offsets.size());
+            pointOffsets.reserve(offsets.size());
+            for (size_t i = 0; i + 1 < offsets.size(); ++i)
+            {
+                if (offsets[i + 1] - offsets[i] < COUNT_PARAMS)
+                    continue;
+                tessellate(params.data() + offsets[i], points);
+                pointOffsets.push_back(static_cast<uint32_t>(points.size()));
+            }
+            if (pointOffsets.size() > 1)
+                drawer.drawPoligons(points, pointOffsets);
+        }
+        static const ::Figure::Type TYPE = ELLIPSE_TYPE;
+        static const size_t COUNT_PARAMS = 4;
+        static const uint32_t LENGTH_PARAMS = (1 << 2) | (1 << 3);  ///< полуоси
+    };
+
+    /*!
+         \brief Незамкнутая ломаная с любым количеством вершин, не меньше двух
+     */
+    class Polyline : public Figure::Figure
+    {
+    public:
+        Polyline() : Figure(TYPE, COUNT_PARAMS, LENGTH_PARAMS) {}
+        virtual ~Polyline() = default;
+        void draw(const Drawer::IDrawer &drawer, Utils::Span<const double> params) const override
+        {
+            if (params.size() >= 4 && params.size() % 2 == 0)
+                drawer.drawPolyline(params);
+        }
+        /*!
+             \brief Ломаные пакета уходят одним вызовом IDrawer::drawPolylines(), если все они допустимы
+         */
+        void drawBatch(const Drawer::IDrawer &drawer, Utils::Span<const double> params, Utils::Span<const uint32_t> offsets) const override
+        {
+            for (size_t i = 0; i + 1 < offsets.size(); ++i)
+            {
+                const uint32_t count = offsets[i + 1] - offsets[i];
+                if (count < 4 || count % 2)
+                    return Figure::drawBatch(drawer, params, offsets);
+            }
+            if (offsets.size() > 1)
+                drawer.drawPolylines(params, offsets);
+        }
+        static const ::Figure::Type TYPE = POLYLINE_TYPE;
+        static const size_t COUNT_PARAMS = 0;   ///< по префиксу длины записи
+        static const uint32_t LENGTH_PARAMS = 0;
+    };
+
+    /*!
+         \brief Регистрация фигур этого файла
+     */
+    inline bool registerShapes(Figure::Factory &factory)
+    {
+        return factory.registerFigure<Ellipse, Polyline>();
+    }
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if __has_include(<glob.h>)
+#include <glob.h>
+#define PROSOFT_HAS_GLOB 1
+#endif
+
+#include "Figure.h"
+#include "Format.h"
+#include "Metrics.h"
+#include "Reader.h"
+#include "Scheduler.h"
+#include "Utils.h"
+
+namespace Sharded
+{
+    /*!
+         \brief Порядок записей объединенного потока
+     */
+    enum Order
+    {
+        eOrdered,   ///< шарды по порядку списка файлов
+        eUnordered  ///< шарды по мере загрузки: медленный шард не задерживает остальные
+    };
+
+#ifdef PROSOFT_HAS_GLOB
+    /*!
+         \brief Файлы по шаблону glob(3), например "tiles/features_*.dat", в порядке имен
+     */
+    inline std::vector<std::string> glob(const std::string &pattern)
+    {
+        std::vector<std::string> res;
+        glob_t found;
+        if (::glob(pattern.c_str(), 0, nullptr, &found) == 0)
+            res.assign(found.gl_pathv, found.gl_pathv + found.gl_pathc);
+        ::globfree(&found);
+        return res;
+    }
+#endif
+
+    /*!
+         \brief Набор файлов данных как один поток записей.
+                Шарды загружаются параллельно задачами общего пула с упреждением не больше
+                чем на 2 * countThreads шардов и отдаются целиком, так что запись никогда
+                не разрывается между шардами: шард, который кончается посреди записи, отбрасывается,
+                а чтение, которому не хватает остатка текущего шарда, завершается ошибкой. Заголовки формата шардов в поток не попадают:
+                все шарды должны быть в формате первого, см. format().
+                Шард, который не открылся или отличается форматом, пропускается, и isOk() становится false
+     */
+    class Reader : public ::Reader::IReader
+    {
+        struct Shard
+        {
+            std::unique_ptr<::Reader::IReader> source;  ///< держит отображение файла для data
+            std::vector<uint8_t> buffer;
+            Utils::Span<const uint8_t> data;
+            uint64_t offset = 0;    ///< смещение начала шарда в объединенном потоке
+            size_t pos = 0;
+            bool ok = true;
+        };
+        struct State
+        {
+            std::vector<std::string> files;
+            Order order = eOrdered;
+            Format::Format format;
+            size_t window = 0;
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::map<size_t, Shard> ready;  ///< по номеру файла или по порядку загрузки для eUnordered
+            size_t claimed = 0;     ///< количество шардов, взятых потоками загрузки
+            size_t loaded = 0;
+            size_t nextTake = 0;
+            uint64_t nextOffset = 0;
+            bool failed = false;
+            bool stop = false;
+
+            Shard current;
+            Scheduler::Group tasks;     ///< последним полем: разрушается первым, дождавшись задач
+
+            static bool sameFormat(const Format::Format &a, const Format::Format &b)
+            {
+                return a.header == b.header && a.encoding == b.encoding && a.flags == b.flags
+                    && a.originX == b.originX && a.originY == b.originY && a.scale == b.scale;
+            }
+            /*!
+                 \brief Данные отображенного файла берутся без копирования, остальные источники
+                        вычитываются в буфер наибольшими кусками, которые отдает view()
+             */
+            static void drain(const ::Reader::IReader &source, std::vector<uint8_t> &out)
+            {
+                static const size_t CHUNK = 1 << 20;
+                for (size_t step = CHUNK;;)
+                {
+                    if (const void *chunk = source.view(1, step))
+                    {
+                        const uint8_t *begin = static_cast<const uint8_t*>(chunk);
+                        out.insert(out.end(), begin, begin + step);
+                        step = CHUNK;
+                        continue;
+                    }
+                    if (step > 1)
+                    {
+                        step /= 2;
+                        continue;
+                    }
+                    uint8_t byte;
+                    if (!source.read(&byte, 1))
+                        return;
+                    out.push_back(byte);
+                    step = CHUNK;
+                }
+            }
+            /*!
+                 \brief Данные шарда состоят из целых записей. Размер записи берется из префикса длины,
+                        без него - у встроенной фигуры. Запись неизвестного типа без префикса
+                        отбросит при декодировании сам читатель, проход на ней останавливается
+             */
+            static bool whole(const Format::Format &shardFormat, Utils::Span<const uint8_t> data)
+            {
+                size_t offset = 0;
+                while (offset < data.size())
+                {
+                    if (data.size() - offset < shardFormat.prefixSize())
+                        return false;
+                    Figure::Type type;
+                    memcpy(&type, data.data() + offset, sizeof(type));
+                    size_t recordSize = 0;
+                    if (shardFormat.hasLengthPrefix())
+                    {
+                        uint32_t length;
+                        memcpy(&length, data.data() + offset + sizeof(type), sizeof(length));
+                        recordSize = shardFormat.prefixSize() + length;
+                    }
+                    else if (const size_t countParams = Figure::Figures::countParams(type))
+                    {
+                        recordSize = shardFormat.recordSize(countParams);
+                    }
+                    else
+                    {
+                        return true;
+                    }
+                    if (data.size() - offset < recordSize)
+                        return false;
+                    offset += recordSize;
+                }
+                return true;
+            }
+            bool load(const std::string &filename, Shard &shard) const
+            {
+                // отображение пустого и отсутствующего файла неотличимы
+                std::error_code error;
+                if (!std::filesystem::is_regular_file(filename, error))
+                    return false;
+                shard.source = ::Reader::open(filename);
+                Format::Format shardFormat;
+                if (!Format::detect(*shard.source, shardFormat) || !sameFormat(shardFormat, format))
+                    return false;
+                if (const auto *memory = dynamic_cast<const ::Reader::Memory*>(shard.source.get()))
+                {
+                    const Utils::Span<const uint8_t> all = memory->data();
+                    shard.data = all.subspan(shardFormat.headerSize(), all.size() - shardFormat.headerSize());
+                    PROSOFT_COUNT(eBytesRead, all.size());
+                    return whole(shardFormat, shard.data);
+                }
+                drain(*shard.source, shard.buffer);
+                shard.data = shard.buffer;
+                return whole(shardFormat, shard.data);
+            }
+            /*!
+                 \brief Постановка задач загрузки, пока окно упреждения не заполнено. Вызывается под mutex
+             */
+            void schedule()
+            {
+                for (; !stop && claimed < files.size() && claimed - nextTake < window; ++claimed)
+                    tasks.run([this, index = claimed]() { work(index); });
+            }
+            /*!
+                 \brief Задача пула: загрузка одного шарда
+             */
+            void work(size_t index)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (stop)
+                        return;
+                }
+                Shard shard;
+                if (!load(files[index], shard))
+                {
+                    shard = Shard();
+                    shard.ok = false;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.emplace(order == eOrdered ? index : loaded, std::move(shard));
+                ++loaded;
+                cv.notify_all();
+            }
+            bool next()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true)
+                {
+                    Scheduler::wait(lock, cv, [this]() { return nextTake == files.size() || ready.count(nextTake); }, tasks.pool());
+                    if (nextTake == files.size())
+                        return false;
+
+                    auto it = ready.find(nextTake);
+                    ++nextTake;
+                    schedule();
+                    if (!it->second.ok)
+                    {
+                        failed = true;
+                        ready.erase(it);
+                        continue;
+                    }
+                    nextOffset += current.data.size();
+                    current = std::move(it->second);
+                    current.offset = nextOffset;
+                    ready.erase(it);
+                    if (!current.data.empty())
+                        return true;
+                }
+            }
+            /*!
+                 \brief Непрочитанный остаток текущего шарда, с переходом к следующему в его конце
+             */
+            bool left()
+            {
+                return current.pos < current.data.size() || next();
+            }
+        };
+        std::unique_ptr<State> state;
+
+    public:
+        /*!
+             \param files - файлы шардов, формат записей определяется по первому
+             \param countThreads - наибольшее количество шардов, одновременно загружаемых
+                    задачами Scheduler::Pool::shared(), 0 - по числу потоков пула
+         */
+        explicit Reader(std::vector<std::string> files, Order order = eOrdered, size_t countThreads = 0)
+            : state(new State)
+        {
+            state->files = std::move(files);
+            state->order = order;
+            if (state->files.empty())
+                return;
+            if (!Format::detect(*::Reader::open(state->files.front()), state->format))
+                state->failed = true;
+
+            if (!countThreads)
+                countThreads = state->tasks.pool().concurrency();
+            state->window = 2 * countThreads;
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->schedule();
+        }
+        Reader(const Reader&) = delete;
+        Reader &operator=(const Reader&) = delete;
+        ~Reader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->stop = true;
+            }
+            state->tasks.wait();
+        }
+
+        /*!
+             \brief Чтение в пределах текущего шарда. Граница шарда внутри одного чтения
+                    означает, что запись разорвана, - чтение не выполняется, и isOk() становится false
+         */
+        bool read(void *dst, size_t size, size_t count = 1) const override
+        {
+            if (!dst)
+                return false;
+            const size_t total = size * count;
+            if (!total)
+                return true;
+            if (!state->left())
+                return false;
+
+            Shard &shard = state->current;
+            if (total > shard.data.size() - shard.pos)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->failed = true;
+                return false;
+            }
+            memcpy(dst, shard.data.data() + shard.pos, total);
+            shard.pos += total;
+            return true;
+        }
+        const void *view(size_t size, size_t count = 1) const override
+        {
+            if (!size || !state->left())
+                return nullptr;
+
+            Shard &shard = state->current;
+            if (count > (shard.data.size() - shard.pos) / size)
+                return nullptr;
+            const void *res = shard.data.data() + shard.pos;
+            shard.pos += size * count;
+            return res;
+        }
+        /*!
+             \brief Переход возможен только в пределах текущего шарда,
+                    этого достаточно для Format::detect()
+         */
+        bool seek(uint64_t offset) const override
+        {
+            Shard &shard = state->current;
+            if (offset < shard.offset || offset - shard.offset > shard.data.size())
+                return false;
+            shard.pos = static_cast<size_t>(offset - shard.offset);
+            return true;
+        }
+
+        /*!
+             \brief Формат записей всех шардов. Сам поток без заголовка, поэтому формат
+                    передается в Pipeline::Executor::setFormat() отсюда, а не через Format::detect()
+         */
+        const Format::Format &format() const { return state->format; }
+        size_t countFiles() const { return state->files.size(); }
+        /*!
+             \brief false, если какой-то шард был пропущен
+         */
+        bool isOk() const
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return !state->failed;
+        }
+    };
+}
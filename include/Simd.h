@@ -0,0 +1,18 @@
+#pragma once
+
+/*!
+     \brief Выбор набора векторных инструкций на этапе компиляции.
+            AVX2 включается флагами компилятора (опция PROSOFT_NATIVE), без них на x86-64
+            работают ядра SSE2 из базового набора, NEON входит в базовый набор aarch64.
+            В остальных случаях работают скалярные ветки
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PROSOFT_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PROSOFT_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define PROSOFT_SIMD_NEON 1
+#endif
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Culling.h"
+#include "Drawer.h"
+#include "Feature.h"
+#include "Figure.h"
+#include "Scheduler.h"
+#include "Utils.h"
+
+namespace Spatial
+{
+    /*!
+         \brief Упакованное R-дерево над фигурами FeatureBatch, строится за один проход по методу STR
+                (Sort-Tile-Recursive): на каждом уровне элементы делятся на вертикальные полосы по x,
+                полосы сортируются по y, и подряд идущие NODE_SIZE элементов становятся узлом.
+                Поддеревья лежат непрерывными отрезками, так что узел, целиком попавший в запрос,
+                отдает свои фигуры без проверки каждой
+     */
+    class RTree
+    {
+    public:
+        static constexpr size_t NODE_SIZE = 16;
+
+    private:
+        struct Node
+        {
+            Utils::Rect box;
+            uint32_t first = 0;     ///< первый потомок на уровне ниже или первая фигура для листового узла
+            uint32_t count = 0;
+        };
+        struct Item
+        {
+            Utils::Rect box;
+            uint32_t type = 0;      ///< Figure::Type группы пакета
+            uint32_t index = 0;     ///< номер фигуры в группе
+        };
+
+        std::vector<Item> items;
+        std::vector<std::vector<Node>> levels;  ///< levels[0] - листовые узлы над items, последний - корень
+        std::array<size_t, Figure::eCountTypes> groupSizes{};
+
+        template <typename Entry>
+        static double centerX(const Entry &entry) { return entry.box.minX + entry.box.maxX; }
+        template <typename Entry>
+        static double centerY(const Entry &entry) { return entry.box.minY + entry.box.maxY; }
+
+        /*!
+             \brief Раскладка [begin, end) на полосы по sliceSize элементов, упорядоченные по x.
+                    Внутри полосы порядок не определен, полное упорядочивание по x не нужно
+         */
+        template <typename Iterator>
+        static void partition(Iterator begin, Iterator end, size_t sliceSize, size_t countThreads)
+        {
+            const size_t count = end - begin;
+            if (count <= sliceSize)
+                return;
+            const Iterator middle = begin + (count + sliceSize - 1) / sliceSize / 2 * sliceSize;
+            std::nth_element(begin, middle, end, [](const auto &a, const auto &b) { return centerX(a) < centerX(b); });
+            if (countThreads > 1)
+            {
+                Scheduler::Group group;
+                group.run([=]() { partition(begin, middle, sliceSize, countThreads / 2); });
+                partition(middle, end, sliceSize, countThreads - countThreads / 2);
+                group.wait();
+            }
+            else
+            {
+                partition(begin, middle, sliceSize, 1);
+                partition(middle, end, sliceSize, 1);
+            }
+        }
+        /*!
+             \brief Упорядочивание элементов уровня для упаковки по NODE_SIZE
+         */
+        template <typename Entry>
+        static void order(std::vector<Entry> &entries, size_t countThreads)
+        {
+            if (entries.size() <= NODE_SIZE)
+                return;
+            const size_t countNodes = (entries.size() + NODE_SIZE - 1) / NODE_SIZE;
+            const size_t countSlices = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(countNodes))));
+            const size_t sliceSize = (countNodes + countSlices - 1) / countSlices * NODE_SIZE;
+            partition(entries.begin(), entries.end(), sliceSize, countThreads);
+            Scheduler::parallelFor((entries.size() + sliceSize - 1) / sliceSize, [&](size_t slice)
+            {
+                const auto begin = entries.begin() + slice * sliceSize;
+                const auto end = entries.begin() + std::min(entries.size(), (slice + 1) * sliceSize);
+                std::sort(begin, end, [](const Entry &a, const Entry &b) { return centerY(a) < centerY(b); });
+            }, countThreads);
+        }
+        template <typename Entry>
+        static std::vector<Node> pack(const std::vector<Entry> &entries)
+        {
+            std::vector<Node> res((entries.size() + NODE_SIZE - 1) / NODE_SIZE);
+            for (size_t i = 0; i < res.size(); ++i)
+            {
+                Node &node = res[i];
+                node.first = static_cast<uint32_t>(i * NODE_SIZE);
+                node.count = static_cast<uint32_t>(std::min(NODE_SIZE, entries.size() - node.first));
+                node.box = entries[node.first].box;
+                for (size_t k = 1; k < node.count; ++k)
+                    node.box.unite(entries[node.first + k].box);
+            }
+            return res;
+        }
+        /*!
+             \brief Перестановка потомков в порядке родителей, после которой поддерево
+                    занимает непрерывный отрезок на каждом уровне
+         */
+        template <typename Entry>
+        static void regroup(std::vector<Node> &parents, std::vector<Entry> &children)
+        {
+            std::vector<Entry> res;
+            res.reserve(children.size());
+            for (Node &parent : parents)
+            {
+                const uint32_t first = static_cast<uint32_t>(res.size());
+                res.insert(res.end(), children.begin() + parent.first, children.begin() + parent.first + parent.count);
+                parent.first = first;
+            }
+            children.swap(res);
+        }
+        /*!
+             \brief Отрезок items, покрываемый поддеревом узла
+         */
+        std::pair<size_t, size_t> itemRange(size_t level, size_t index) const
+        {
+            size_t first = index;
+            size_t last = index;
+            for (; level > 0; --level)
+            {
+                first = levels[level][first].first;
+                const Node &node = levels[level][last];
+                last = node.first + node.count - 1;
+            }
+            const Node &node = levels[0][last];
+            return { levels[0][first].first, node.first + node.count };
+        }
+        static void add(std::vector<Item> &items, const Culling::Bounds &bounds, Figure::Type type)
+        {
+            for (size_t i = 0; i < bounds.size(); ++i)
+            {
+                Item item;
+                item.box = bounds.rect(i);
+                // фигуры с NaN не попадают ни в один запрос и ломают упорядочивание
+                if (!(item.box.minX <= item.box.maxX && item.box.minY <= item.box.maxY))
+                    continue;
+                item.type = type;
+                item.index = static_cast<uint32_t>(i);
+                items.push_back(item);
+            }
+        }
+
+    public:
+        /*!
+             \brief Построение дерева над всеми фигурами пакета.
+                    Пакет должен оставаться неизменным, пока по дереву выполняются запросы
+             \param countThreads - наибольшее количество одновременных задач Scheduler::Pool::shared(),
+                    0 - по числу потоков пула
+         */
+        void build(const FeatureBatch &batch, size_t countThreads = 0)
+        {
+            if (!countThreads)
+                countThreads = Scheduler::Pool::shared().concurrency();
+
+            items.clear();
+            levels.clear();
+            groupSizes = {{ batch.circles.size(), batch.triangles.size(), batch.squares.size() }};
+
+            Culling::Bounds bounds[Figure::eCountTypes];
+            Scheduler::parallelFor(Figure::eCountTypes, [&](size_t type)
+            {
+                if (type == Figure::eCircle)
+                    Culling::bounds(batch.circles, bounds[type]);
+                else
+                    Culling::bounds(type == Figure::eTriangle ? batch.triangles : batch.squares, bounds[type]);
+            }, countThreads);
+            items.reserve(batch.size());
+            for (size_t type = 0; type < Figure::eCountTypes; ++type)
+                add(items, bounds[type], static_cast<Figure::Type>(type));
+            if (items.empty())
+                return;
+
+            order(items, countThreads);
+            levels.push_back(pack(items));
+            while (levels.back().size() > 1)
+            {
+                order(levels.back(), countThreads);
+                levels.push_back(pack(levels.back()));
+            }
+            for (size_t level = levels.size() - 1; level > 0; --level)
+                regroup(levels[level], levels[level - 1]);
+            regroup(levels[0], items);
+        }
+
+        size_t size() const { return items.size(); }
+        bool empty() const { return items.empty(); }
+        size_t height() const { return levels.size(); }
+        /*!
+             \brief Охват всех фигур дерева
+         */
+        Utils::Rect bounds() const { return levels.empty() ? Utils::Rect() : levels.back().front().box; }
+
+        /*!
+             \brief Обход фигур, пересекающих rect: onItem(Figure::Type, индекс в группе пакета)
+         */
+        template <typename OnItem>
+        void query(const Utils::Rect &rect, OnItem &&onItem) const
+        {
+            if (levels.empty())
+                return;
+
+            auto contains = [&rect](const Utils::Rect &box)
+            {
+                return rect.minX <= box.minX && box.maxX <= rect.maxX && rect.minY <= box.minY && box.maxY <= rect.maxY;
+            };
+            auto emit = [this, &onItem](size_t first, size_t last)
+            {
+                for (size_t i = first; i < last; ++i)
+                    onItem(static_cast<Figure::Type>(items[i].type), items[i].index);
+            };
+
+            std::vector<std::pair<size_t, size_t>> stack;   // уровень и номер узла
+            stack.emplace_back(levels.size() - 1, 0);
+            while (!stack.empty())
+            {
+                const std::pair<size_t, size_t> top = stack.back();
+                stack.pop_back();
+                const Node &node = levels[top.first][top.second];
+                if (!node.box.intersects(rect))
+                    continue;
+                if (contains(node.box))
+                {
+                    const std::pair<size_t, size_t> range = itemRange(top.first, top.second);
+                    emit(range.first, range.second);
+                    continue;
+                }
+                if (top.first == 0)
+                {
+                    for (size_t i = node.first; i < node.first + node.count; ++i)
+                        if (items[i].box.intersects(rect))
+                            onItem(static_cast<Figure::Type>(items[i].type), items[i].index);
+                    continue;
+                }
+                for (size_t i = node.first + node.count; i-- > node.first;)
+                    stack.emplace_back(top.first - 1, i);
+            }
+        }
+        /*!
+             \brief Отметка фигур, пересекающих rect, в выборке по размерам групп пакета
+             \return количество отмеченных фигур
+         */
+        size_t query(const Utils::Rect &rect, FeatureBatch::Selection &res) const
+        {
+            Utils::Bitmap *groups[Figure::eCountTypes] = { &res.circles, &res.triangles, &res.squares };
+            for (size_t type = 0; type < Figure::eCountTypes; ++type)
+                groups[type]->assign(groupSizes[type], false);
+            size_t count = 0;
+            query(rect, [&](Figure::Type type, size_t index)
+            {
+                groups[type]->set(index);
+                ++count;
+            });
+            return count;
+        }
+    };
+
+    /*!
+         \brief Пакет фигур вместе с деревом над ним для повторяющихся запросов по области.
+                Результат запроса - пакет, который рисуется пакетными вызовами IDrawer
+     */
+    class Index
+    {
+        FeatureBatch _batch;
+        RTree _tree;
+
+    public:
+        /*!
+             \param countThreads - наибольшее количество одновременных задач построения, 0 - по числу потоков пула
+         */
+        void build(FeatureBatch batch, size_t countThreads = 0)
+        {
+            _batch = std::move(batch);
+            _tree.build(_batch, countThreads);
+        }
+        const FeatureBatch &batch() const { return _batch; }
+        const RTree &tree() const { return _tree; }
+
+        /*!
+             \brief Фигуры, пересекающие rect, в порядке записей источника внутри каждого типа
+             \param res - очищается перед заполнением
+             \return количество найденных фигур
+         */
+        size_t query(const Utils::Rect &rect, FeatureBatch &res) const
+        {
+            FeatureBatch::Selection selection;
+            const size_t count = _tree.query(rect, selection);
+            res.clear();
+            res.append(_batch, selection);
+            return count;
+        }
+        /*!
+             \brief Отрисовка фигур, пересекающих rect
+             \return количество отрисованных фигур
+         */
+        size_t draw(const Utils::Rect &rect, const Drawer::IDrawer &drawer) const
+        {
+            FeatureBatch res;
+            query(rect, res);
+            res.draw(drawer);
+            return res.size();
+        }
+    };
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include "Drawer.h"
+#include "Feature.h"
+#include "Metrics.h"
+#include "Utils.h"
+
+namespace Tessellation
+{
+    /*!
+         \brief Разбиение многоугольника на треугольники отсечением ушей. Выпуклые и невыпуклые
+                многоугольники без самопересечений разбиваются точно, остаток, в котором ухо
+                не нашлось (самопересечение, нулевая площадь), - веером от первой вершины
+         \param base - номер первой вершины многоугольника в общем массиве вершин
+         \param scratch - рабочий буфер, чтобы не выделять память на каждый многоугольник
+     */
+    inline void triangulate(Utils::Span<const double> points, uint32_t base, std::vector<uint32_t> &indices, std::vector<uint32_t> &scratch)
+    {
+        const uint32_t count = static_cast<uint32_t>(points.size() / 2);
+        auto emit = [&](uint32_t a, uint32_t b, uint32_t c)
+        {
+            indices.push_back(base + a);
+            indices.push_back(base + b);
+            indices.push_back(base + c);
+        };
+        if (count < 3)
+            return;
+        if (count == 3)
+        {
+            emit(0, 1, 2);
+            return;
+        }
+
+        auto cross = [&points](uint32_t a, uint32_t b, uint32_t c)
+        {
+            return (points[2 * b] - points[2 * a]) * (points[2 * c + 1] - points[2 * a + 1])
+                 - (points[2 * b + 1] - points[2 * a + 1]) * (points[2 * c] - points[2 * a]);
+        };
+        double area = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t next = (i + 1) % count;
+            area += points[2 * i] * points[2 * next + 1] - points[2 * next] * points[2 * i + 1];
+        }
+        // обход по часовой стрелке сводится к обходу против нее сменой знака
+        const double sign = area > 0 ? 1 : -1;
+
+        scratch.resize(count);
+        std::iota(scratch.begin(), scratch.end(), 0);
+        while (area != 0 && scratch.size() > 3)
+        {
+            const size_t size = scratch.size();
+            bool clipped = false;
+            for (size_t i = 0; i < size && !clipped; ++i)
+            {
+                const uint32_t a = scratch[(i + size - 1) % size];
+                const uint32_t b = scratch[i];
+                const uint32_t c = scratch[(i + 1) % size];
+                if (!(sign * cross(a, b, c) > 0))
+                    continue;
+                bool empty = true;
+                for (uint32_t p : scratch)
+                {
+                    if (p != a && p != b && p != c
+                        && sign * cross(a, b, p) >= 0 && sign * cross(b, c, p) >= 0 && sign * cross(c, a, p) >= 0)
+                    {
+                        empty = false;
+                        break;
+                    }
+                }
+                if (!empty)
+                    continue;
+                emit(a, b, c);
+                scratch.erase(scratch.begin() + i);
+                clipped = true;
+            }
+            if (!clipped)
+                break;
+        }
+        for (size_t i = 1; i + 1 < scratch.size(); ++i)
+            emit(scratch[0], scratch[i], scratch[i + 1]);
+    }
+
+    /*!
+         \brief Кэш треугольных сеток многоугольников пакетов для IDrawer с hasMeshes().
+                Треугольники и квадраты пакета собираются в одну сетку, которая хранится
+                по диапазону номеров их записей и хешу самих номеров, так что пакет тех же записей
+                в следующих кадрах уходит на отрисовку готовой сеткой без обхода вершин.
+                Разные выборки одного диапазона (другое отсечение, Lod) хранятся отдельно:
+                сетка хранит номера своих записей и при совпадении хешей сверяет их целиком.
+                Кэш не видит изменения параметров записей: о них сообщает invalidate().
+                Круги и фигуры others рисуются как обычно, а без hasMeshes() весь пакет
+                рисуется через FeatureBatch::draw()
+     */
+    class Cache
+    {
+    public:
+        /*!
+             \brief Диапазон номеров записей [first, end)
+         */
+        struct Range
+        {
+            uint64_t first = 0;
+            uint64_t end = 0;
+
+            bool intersects(const Range &other) const { return first < other.end && other.first < end; }
+        };
+
+        static constexpr size_t DEFAULT_CAPACITY = size_t(256) << 20;
+
+    private:
+        struct Entry
+        {
+            uint64_t id = 0;
+            uint64_t version = 0;
+            std::vector<double> vertices;
+            std::vector<uint32_t> indices;
+            std::vector<uint64_t> ids;  ///< номера записей triangles, затем squares
+            uint64_t lastUsed = 0;
+            bool valid = false;
+
+            size_t bytes() const
+            {
+                return vertices.size() * sizeof(double) + indices.size() * sizeof(uint32_t) + ids.size() * sizeof(uint64_t);
+            }
+            bool matches(const FeatureBatch &batch) const
+            {
+                const std::vector<uint64_t> &triangles = batch.triangles.ids;
+                const std::vector<uint64_t> &squares = batch.squares.ids;
+                return ids.size() == triangles.size() + squares.size()
+                    && std::equal(triangles.begin(), triangles.end(), ids.begin())
+                    && std::equal(squares.begin(), squares.end(), ids.begin() + triangles.size());
+            }
+        };
+        using Key = std::tuple<uint64_t, uint64_t, uint64_t>;  ///< first, end, хеш номеров записей
+
+        std::map<Key, Entry> entries;
+        std::vector<uint64_t> released;     ///< сетки, удаленные вне draw(): drawer узнает о них при следующей отрисовке
+        std::vector<uint32_t> scratch;
+        size_t _capacity;
+        size_t _bytes = 0;
+        uint64_t nextId = 1;
+        uint64_t countUses = 0;
+
+        /*!
+             \brief Диапазон записей многоугольников пакета. Номера в группах идут по возрастанию
+         */
+        static Range range(const FeatureBatch &batch)
+        {
+            Range res{ std::numeric_limits<uint64_t>::max(), 0 };
+            for (const FeatureBatch::Poligons *group : { &batch.triangles, &batch.squares })
+            {
+                if (!group->size())
+                    continue;
+                res.first = std::min(res.first, group->ids.front());
+                res.end = std::max(res.end, group->ids.back() + 1);
+            }
+            return res;
+        }
+        static Range range(const Key &key) { return { std::get<0>(key), std::get<1>(key) }; }
+        /*!
+             \brief Хеш номеров записей многоугольников пакета: разные выборки одного диапазона
+                    почти всегда различаются ключом, совпадения отсеивает Entry::matches()
+         */
+        static uint64_t hash(const FeatureBatch &batch)
+        {
+            uint64_t res = 0;
+            for (const FeatureBatch::Poligons *group : { &batch.triangles, &batch.squares })
+            {
+                for (uint64_t id : group->ids)
+                {
+                    res = (res ^ id) * 0x100000001b3ull;
+                    res ^= res >> 29;
+                }
+                res = (res ^ group->size()) * 0x9e3779b97f4a7c15ull;
+            }
+            return res;
+        }
+
+        void build(Entry &entry, const FeatureBatch &batch)
+        {
+            _bytes -= entry.bytes();
+            entry.vertices.clear();
+            entry.indices.clear();
+            entry.ids.assign(batch.triangles.ids.begin(), batch.triangles.ids.end());
+            entry.ids.insert(entry.ids.end(), batch.squares.ids.begin(), batch.squares.ids.end());
+            uint32_t base = 0;
+            for (const FeatureBatch::Poligons *group : { &batch.triangles, &batch.squares })
+            {
+                entry.vertices.insert(entry.vertices.end(), group->points.begin(), group->points.end());
+                for (size_t i = 0; i < group->size(); ++i)
+                {
+                    triangulate(group->poligon(i), base, entry.indices, scratch);
+                    base += static_cast<uint32_t>(group->countParams / 2);
+                }
+            }
+            ++entry.version;
+            entry.valid = true;
+            _bytes += entry.bytes();
+        }
+        void erase(std::map<Key, Entry>::iterator it)
+        {
+            _bytes -= it->second.bytes();
+            released.push_back(it->second.id);
+            entries.erase(it);
+        }
+        /*!
+             \brief Данные сетки освобождаются, номер остается: перестроенная сетка
+                    придет в drawer с тем же id и новой version
+         */
+        void drop(Entry &entry)
+        {
+            _bytes -= entry.bytes();
+            entry.valid = false;
+            entry.vertices = std::vector<double>();
+            entry.indices = std::vector<uint32_t>();
+            entry.ids = std::vector<uint64_t>();
+        }
+        /*!
+             \brief Удаление давно не используемых сеток, пока кэш больше capacity(). keep не удаляется
+         */
+        void evict(const Entry &keep)
+        {
+            while (_bytes > _capacity)
+            {
+                auto oldest = entries.end();
+                for (auto it = entries.begin(); it != entries.end(); ++it)
+                    if (&it->second != &keep && (oldest == entries.end() || it->second.lastUsed < oldest->second.lastUsed))
+                        oldest = it;
+                if (oldest == entries.end())
+                    return;
+                erase(oldest);
+            }
+        }
+
+    public:
+        /*!
+             \param capacity - наибольший объем сеток в байтах
+         */
+        explicit Cache(size_t capacity = DEFAULT_CAPACITY)
+            : _capacity(capacity)
+        {
+        }
+        size_t capacity() const { return _capacity; }
+        size_t size() const { return entries.size(); }
+        size_t bytes() const { return _bytes; }
+
+        /*!
+             \brief Отрисовка пакета с многоугольниками из кэша. Сетка строится, если ее нет
+                    или ее записи изменились
+         */
+        void draw(const Drawer::IDrawer &drawer, const FeatureBatch &batch)
+        {
+            for (uint64_t id : released)
+                drawer.releaseMesh(id);
+            released.clear();
+            if (!drawer.hasMeshes())
+                return batch.draw(drawer);
+
+            const FeatureBatch::Circles &circles = batch.circles;
+            if (circles.size())
+            {
+                PROSOFT_COUNT(eDrawCalls, 1);
+                drawer.drawCircles(circles.centerX, circles.centerY, circles.radius);
+            }
+            if (batch.triangles.size() + batch.squares.size())
+            {
+                const Range key = range(batch);
+                Entry &entry = entries[Key(key.first, key.end, hash(batch))];
+                if (!entry.id)
+                    entry.id = nextId++;
+                if (entry.valid && entry.matches(batch))
+                {
+                    PROSOFT_COUNT(eMeshesReused, 1);
+                }
+                else
+                {
+                    build(entry, batch);
+                    PROSOFT_COUNT(eMeshesBuilt, 1);
+                }
+                entry.lastUsed = ++countUses;
+
+                Drawer::Mesh mesh;
+                mesh.id = entry.id;
+                mesh.version = entry.version;
+                mesh.vertices = entry.vertices;
+                mesh.indices = entry.indices;
+                PROSOFT_COUNT(eDrawCalls, 1);
+                drawer.drawMesh(mesh);
+                evict(entry);
+                for (uint64_t id : released)
+                    drawer.releaseMesh(id);
+                released.clear();
+            }
+            batch.drawOthers(drawer);
+            PROSOFT_COUNT(eFiguresDrawn, batch.size());
+        }
+
+        /*!
+             \brief Изменилась запись id: сетки с ней перестроятся при следующей отрисовке
+         */
+        void invalidate(uint64_t id) { invalidate(Range{ id, id + 1 }); }
+        /*!
+             \brief Изменились записи range
+         */
+        void invalidate(const Range &records)
+        {
+            for (auto &item : entries)
+            {
+                // сетки упорядочены по началу диапазона, дальше все начинаются после records
+                if (std::get<0>(item.first) >= records.end)
+                    break;
+                if (range(item.first).intersects(records) && item.second.valid)
+                    drop(item.second);
+            }
+        }
+        /*!
+             \brief Удаление всех сеток, например при смене источника
+         */
+        void clear()
+        {
+            while (!entries.empty())
+                erase(entries.begin());
+        }
+    };
+}
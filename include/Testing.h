@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "Drawer.h"
+#include "Figure.h"
+#include "Reader.h"
+#include "Utils.h"
+
+namespace Testing
+{
+    /*!
+         \brief Тестовый mock объект для чтения данных
+     */
+    class ReaderMock : public Reader::IReader
+    {
+        mutable size_t countRecords;
+
+    public:
+        explicit ReaderMock(size_t countRecords_ = 1)
+        : countRecords(countRecords_)
+        {
+        }
+        bool read(void *dst, size_t /*size*/, size_t count = 1) const override
+        {
+            if (count == 1) // reading of type
+            {
+                if (!countRecords)
+                    return false;
+                --countRecords;
+
+                const Figure::Type value = Figure::eCircle;
+                memcpy(dst, &value, sizeof(value));
+                std::cout << "ReaderMock::read(): type: eCircle" << std::endl;
+                return true;
+            }
+
+            // reading of params
+            std::cout << "ReaderMock::read(): params: { ";
+            const double value = 2.1;
+            while(count--)
+            {
+                std::cout << value << " ";
+                memcpy(dst, &value, sizeof(value));
+                dst = reinterpret_cast<uint8_t*>(dst) + sizeof(value);
+            }
+            std::cout << "} " << std::endl;
+            return true;
+        }
+    };
+
+    /*!
+         \brief Тестовый mock объект для отрисовки
+     */
+    class DrawerMock : public Drawer::IDrawer
+    {
+    public:
+        void drawCircle(double centerX, double centerY, double radius)  const override
+        {
+            std::cout << "DrawerMock::drawCircle():"
+                      << " centerX = " << centerX
+                      << " centerY = " << centerY
+                      << " radius = "  << radius
+                      << std::endl;
+        }
+
+        void drawPoligon(Utils::Span<const double> points)  const override
+        {
+            std::cout << "DrawerMock::drawPoligon(): params: { ";
+            std::copy(points.cbegin(), points.cend(), std::ostream_iterator<double>(std::cout, " "));
+            std::cout << "} " << std::endl;
+        }
+    };
+
+    /*!
+         \brief Тестовый объект для отрисовки без вывода, только считает вызовы.
+                Контрольная сумма не дает компилятору выбросить отрисовку при замерах
+     */
+    class DrawerFake : public Drawer::IDrawer
+    {
+        mutable uint64_t _countCalls = 0;
+        mutable double _checksum = 0;
+
+    public:
+        void drawCircle(double centerX, double centerY, double radius) const override
+        {
+            ++_countCalls;
+            _checksum += centerX + centerY + radius;
+        }
+        void drawPoligon(Utils::Span<const double> points) const override
+        {
+            ++_countCalls;
+            _checksum += points.empty() ? 0 : points[0];
+        }
+        uint64_t countCalls() const { return _countCalls; }
+        double checksum() const { return _checksum; }
+    };
+
+    /*!
+         \brief Формирование countRecords записей в формате features.dat в памяти.
+                Типы берутся из types по кругу, параметры - номер записи
+     */
+    inline std::vector<uint8_t> makeRecords(const Figure::Factory &figureFactory,
+                                            Utils::Span<const Figure::Type> types,
+                                            size_t countRecords)
+    {
+        std::vector<uint8_t> data;
+        for (size_t i = 0; i < countRecords && !types.empty(); ++i)
+        {
+            const Figure::Type type = types[i % types.size()];
+            const Figure::Figure *figure = figureFactory.prototype(type);
+            if (!figure)
+                break;
+
+            const size_t pos = data.size();
+            data.resize(pos + sizeof(type) + figure->countParams() * sizeof(double));
+            memcpy(data.data() + pos, &type, sizeof(type));
+            for (size_t j = 0; j < figure->countParams(); ++j)
+            {
+                const double value = static_cast<double>(i);
+                memcpy(data.data() + pos + sizeof(type) + j * sizeof(value), &value, sizeof(value));
+            }
+        }
+        return data;
+    }
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#include "Feature.h"
+#include "Simd.h"
+
+namespace Transform
+{
+    /*!
+         \brief Аффинное преобразование координат:
+                x' = a * x + b * y + tx
+                y' = c * x + d * y + ty
+     */
+    struct Affine
+    {
+        double a = 1;
+        double b = 0;
+        double c = 0;
+        double d = 1;
+        double tx = 0;
+        double ty = 0;
+
+        static Affine identity() { return Affine(); }
+        /*!
+             \brief Масштабирование с последующим сдвигом
+         */
+        static Affine scaleTranslate(double scaleX, double scaleY, double translateX, double translateY)
+        {
+            return { scaleX, 0, 0, scaleY, translateX, translateY };
+        }
+        /*!
+             \brief Преобразование мировых координат в экранные для панорамирования и масштаба:
+                    точка (centerX, centerY) попадает в (screenX, screenY)
+         */
+        static Affine panZoom(double zoom, double centerX, double centerY, double screenX = 0, double screenY = 0)
+        {
+            return scaleTranslate(zoom, zoom, screenX - zoom * centerX, screenY - zoom * centerY);
+        }
+        /*!
+             \brief Композиция: сначала other, затем this
+         */
+        Affine operator*(const Affine &other) const
+        {
+            return { a * other.a + b * other.c, a * other.b + b * other.d,
+                     c * other.a + d * other.c, c * other.b + d * other.d,
+                     a * other.tx + b * other.ty + tx, c * other.tx + d * other.ty + ty };
+        }
+        /*!
+             \brief Множитель длин, применяемый к радиусам.
+                    Для неравномерного масштаба круг остается кругом равной площади
+         */
+        double scale() const { return std::sqrt(std::fabs(a * d - b * c)); }
+    };
+
+    /*!
+         \brief Векторные ядра. Возвращают количество обработанных элементов для скалярного хвоста
+     */
+    namespace Kernels
+    {
+#if defined(PROSOFT_SIMD_AVX2)
+        inline __m256d madd(__m256d x, __m256d y, __m256d z)
+        {
+#if defined(__FMA__)
+            return _mm256_fmadd_pd(x, y, z);
+#else
+            return _mm256_add_pd(_mm256_mul_pd(x, y), z);
+#endif
+        }
+        inline size_t columns(const Affine &m, const double *x, const double *y, double *outX, double *outY, size_t count)
+        {
+            const __m256d a = _mm256_set1_pd(m.a), b = _mm256_set1_pd(m.b), tx = _mm256_set1_pd(m.tx);
+            const __m256d c = _mm256_set1_pd(m.c), d = _mm256_set1_pd(m.d), ty = _mm256_set1_pd(m.ty);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                const __m256d vx = _mm256_loadu_pd(x + i);
+                const __m256d vy = _mm256_loadu_pd(y + i);
+                _mm256_storeu_pd(outX + i, madd(a, vx, madd(b, vy, tx)));
+                _mm256_storeu_pd(outY + i, madd(c, vx, madd(d, vy, ty)));
+            }
+            return i;
+        }
+        /*!
+             \brief Точки, упакованные парами x, y: по 2 точки на регистр
+         */
+        inline size_t points(const Affine &m, const double *xy, double *out, size_t countPoints)
+        {
+            const __m256d diag = _mm256_setr_pd(m.a, m.d, m.a, m.d);
+            const __m256d cross = _mm256_setr_pd(m.b, m.c, m.b, m.c);
+            const __m256d shift = _mm256_setr_pd(m.tx, m.ty, m.tx, m.ty);
+            size_t i = 0;
+            for (; i + 2 <= countPoints; i += 2)
+            {
+                const __m256d v = _mm256_loadu_pd(xy + 2 * i);
+                const __m256d swapped = _mm256_permute_pd(v, 0x5);   // y0 x0 y1 x1
+                _mm256_storeu_pd(out + 2 * i, madd(diag, v, madd(cross, swapped, shift)));
+            }
+            return i;
+        }
+        inline size_t scale(const double *src, double *dst, size_t count, double factor)
+        {
+            const __m256d f = _mm256_set1_pd(factor);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+                _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(src + i), f));
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_SSE2)
+        inline size_t columns(const Affine &m, const double *x, const double *y, double *outX, double *outY, size_t count)
+        {
+            const __m128d a = _mm_set1_pd(m.a), b = _mm_set1_pd(m.b), tx = _mm_set1_pd(m.tx);
+            const __m128d c = _mm_set1_pd(m.c), d = _mm_set1_pd(m.d), ty = _mm_set1_pd(m.ty);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+            {
+                const __m128d vx = _mm_loadu_pd(x + i);
+                const __m128d vy = _mm_loadu_pd(y + i);
+                _mm_storeu_pd(outX + i, _mm_add_pd(_mm_mul_pd(a, vx), _mm_add_pd(_mm_mul_pd(b, vy), tx)));
+                _mm_storeu_pd(outY + i, _mm_add_pd(_mm_mul_pd(c, vx), _mm_add_pd(_mm_mul_pd(d, vy), ty)));
+            }
+            return i;
+        }
+        /*!
+             \brief Точки, упакованные парами x, y: по точке на регистр
+         */
+        inline size_t points(const Affine &m, const double *xy, double *out, size_t countPoints)
+        {
+            const __m128d diag = _mm_setr_pd(m.a, m.d);
+            const __m128d cross = _mm_setr_pd(m.b, m.c);
+            const __m128d shift = _mm_setr_pd(m.tx, m.ty);
+            for (size_t i = 0; i < countPoints; ++i)
+            {
+                const __m128d v = _mm_loadu_pd(xy + 2 * i);
+                const __m128d swapped = _mm_shuffle_pd(v, v, 0x1);     // y x
+                _mm_storeu_pd(out + 2 * i, _mm_add_pd(_mm_mul_pd(diag, v), _mm_add_pd(_mm_mul_pd(cross, swapped), shift)));
+            }
+            return countPoints;
+        }
+        inline size_t scale(const double *src, double *dst, size_t count, double factor)
+        {
+            const __m128d f = _mm_set1_pd(factor);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+                _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(src + i), f));
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_NEON)
+        inline size_t columns(const Affine &m, const double *x, const double *y, double *outX, double *outY, size_t count)
+        {
+            const float64x2_t a = vdupq_n_f64(m.a), b = vdupq_n_f64(m.b), tx = vdupq_n_f64(m.tx);
+            const float64x2_t c = vdupq_n_f64(m.c), d = vdupq_n_f64(m.d), ty = vdupq_n_f64(m.ty);
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+            {
+                const float64x2_t vx = vld1q_f64(x + i);
+                const float64x2_t vy = vld1q_f64(y + i);
+                vst1q_f64(outX + i, vfmaq_f64(vfmaq_f64(tx, b, vy), a, vx));
+                vst1q_f64(outY + i, vfmaq_f64(vfmaq_f64(ty, d, vy), c, vx));
+            }
+            return i;
+        }
+        inline size_t points(const Affine &m, const double *xy, double *out, size_t countPoints)
+        {
+            const double diagValues[2] = { m.a, m.d };
+            const double crossValues[2] = { m.b, m.c };
+            const double shiftValues[2] = { m.tx, m.ty };
+            const float64x2_t diag = vld1q_f64(diagValues);
+            const float64x2_t cross = vld1q_f64(crossValues);
+            const float64x2_t shift = vld1q_f64(shiftValues);
+            for (size_t i = 0; i < countPoints; ++i)
+            {
+                const float64x2_t v = vld1q_f64(xy + 2 * i);
+                const float64x2_t swapped = vextq_f64(v, v, 1);     // y x
+                vst1q_f64(out + 2 * i, vfmaq_f64(vfmaq_f64(shift, cross, swapped), diag, v));
+            }
+            return countPoints;
+        }
+        inline size_t scale(const double *src, double *dst, size_t count, double factor)
+        {
+            size_t i = 0;
+            for (; i + 2 <= count; i += 2)
+                vst1q_f64(dst + i, vmulq_n_f64(vld1q_f64(src + i), factor));
+            return i;
+        }
+#else
+        inline size_t columns(const Affine &, const double *, const double *, double *, double *, size_t) { return 0; }
+        inline size_t points(const Affine &, const double *, double *, size_t) { return 0; }
+        inline size_t scale(const double *, double *, size_t, double) { return 0; }
+#endif
+    }
+
+    /*!
+         \brief Преобразование колонок координат x, y. Выход может совпадать со входом
+     */
+    inline void columns(const Affine &m, const double *x, const double *y, double *outX, double *outY, size_t count)
+    {
+        for (size_t i = Kernels::columns(m, x, y, outX, outY, count); i < count; ++i)
+        {
+            const double vx = x[i];
+            const double vy = y[i];
+            outX[i] = m.a * vx + m.b * vy + m.tx;
+            outY[i] = m.c * vx + m.d * vy + m.ty;
+        }
+    }
+    /*!
+         \brief Преобразование точек, упакованных парами x, y. Выход может совпадать со входом
+     */
+    inline void points(const Affine &m, const double *xy, double *out, size_t countPoints)
+    {
+        for (size_t i = Kernels::points(m, xy, out, countPoints); i < countPoints; ++i)
+        {
+            const double vx = xy[2 * i];
+            const double vy = xy[2 * i + 1];
+            out[2 * i] = m.a * vx + m.b * vy + m.tx;
+            out[2 * i + 1] = m.c * vx + m.d * vy + m.ty;
+        }
+    }
+    /*!
+         \brief Умножение колонки на константу. Выход может совпадать со входом
+     */
+    inline void scale(const double *src, double *dst, size_t count, double factor)
+    {
+        for (size_t i = Kernels::scale(src, dst, count, factor); i < count; ++i)
+            dst[i] = src[i] * factor;
+    }
+
+    /*!
+         \brief Преобразование параметров одной записи по маске длин Figure::Figure::lengthParams():
+                длины умножаются на Affine::scale(), соседние координаты x, y преобразуются как точки.
+                Координата без пары копируется как есть. Выход может совпадать со входом
+     */
+    inline void params(const Affine &m, uint32_t lengthParams, const double *src, double *dst, size_t count)
+    {
+        const auto isLength = [lengthParams](size_t index) { return index < 32 && (lengthParams & (1u << index)); };
+        const double factor = m.scale();
+        size_t i = 0;
+        while (i < count)
+        {
+            if (isLength(i))
+            {
+                dst[i] = src[i] * factor;
+                ++i;
+                continue;
+            }
+            size_t end = i;
+            while (end < count && !isLength(end))
+                ++end;
+            if (i % 2)
+            {
+                dst[i] = src[i];
+                ++i;
+            }
+            const size_t countPoints = (end - i) / 2;
+            points(m, src + i, dst + i, countPoints);
+            i += 2 * countPoints;
+            if (i < end)
+            {
+                dst[i] = src[i];
+                ++i;
+            }
+        }
+    }
+    /*!
+         \brief Преобразование параметров всех записей группы FeatureBatch::others
+     */
+    inline void group(const Affine &m, const FeatureBatch::Group &src, FeatureBatch::Group &dst)
+    {
+        const uint32_t lengthParams = src.figure ? src.figure->lengthParams() : 0;
+        for (size_t i = 0; i < src.size(); ++i)
+        {
+            const uint32_t offset = src.offsets[i];
+            const size_t count = src.offsets[i + 1] - offset;
+            if (lengthParams)
+                params(m, lengthParams, src.params.data() + offset, dst.params.data() + offset, count);
+            else
+                points(m, src.params.data() + offset, dst.params.data() + offset, count / 2);
+        }
+    }
+
+    /*!
+         \brief Преобразование всех фигур пакета на месте
+     */
+    inline void apply(const Affine &m, FeatureBatch &batch)
+    {
+        FeatureBatch::Circles &circles = batch.circles;
+        columns(m, circles.centerX.data(), circles.centerY.data(), circles.centerX.data(), circles.centerY.data(), circles.size());
+        scale(circles.radius.data(), circles.radius.data(), circles.size(), m.scale());
+        for (FeatureBatch::Poligons *group : { &batch.triangles, &batch.squares })
+            points(m, group->points.data(), group->points.data(), group->points.size() / 2);
+        for (FeatureBatch::Group &other : batch.others)
+            group(m, other, other);
+    }
+    /*!
+         \brief Преобразованная копия пакета: исходные данные остаются нетронутыми,
+                так что каждый кадр проецируется заново без повторного чтения
+     */
+    inline void apply(const Affine &m, const FeatureBatch &src, FeatureBatch &dst)
+    {
+        dst.circles.centerX.resize(src.circles.size());
+        dst.circles.centerY.resize(src.circles.size());
+        dst.circles.radius.resize(src.circles.size());
+        dst.circles.ids = src.circles.ids;
+        columns(m, src.circles.centerX.data(), src.circles.centerY.data(),
+                dst.circles.centerX.data(), dst.circles.centerY.data(), src.circles.size());
+        scale(src.circles.radius.data(), dst.circles.radius.data(), src.circles.size(), m.scale());
+
+        const std::pair<const FeatureBatch::Poligons*, FeatureBatch::Poligons*> groups[] = {
+            { &src.triangles, &dst.triangles }, { &src.squares, &dst.squares } };
+        for (const auto &group : groups)
+        {
+            group.second->points.resize(group.first->points.size());
+            group.second->offsets = group.first->offsets;
+            group.second->ids = group.first->ids;
+            points(m, group.first->points.data(), group.second->points.data(), group.first->points.size() / 2);
+        }
+
+        dst.others.resize(src.others.size());
+        for (size_t i = 0; i < src.others.size(); ++i)
+        {
+            const FeatureBatch::Group &from = src.others[i];
+            FeatureBatch::Group &to = dst.others[i];
+            to.figure = from.figure;
+            to.params.resize(from.params.size());
+            to.offsets = from.offsets;
+            to.ids = from.ids;
+            group(m, from, to);
+        }
+    }
+}
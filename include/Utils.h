@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Utils
+{
+    /*!
+         \brief Невладеющее представление непрерывного участка памяти
+     */
+    template <typename T>
+    class Span
+    {
+        T *_data = nullptr;
+        size_t _size = 0;
+
+    public:
+        Span() = default;
+        Span(T *data_, size_t size_)
+        : _data(data_),
+          _size(size_)
+        {
+        }
+        template <typename Container>
+        Span(Container &container)
+        : _data(container.data()),
+          _size(container.size())
+        {
+        }
+        T *data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return !_size; }
+        T &operator[](size_t index) const { return _data[index]; }
+        T *begin() const { return _data; }
+        T *end() const { return _data + _size; }
+        const T *cbegin() const { return _data; }
+        const T *cend() const { return _data + _size; }
+        Span subspan(size_t offset, size_t count) const { return Span(_data + offset, count); }
+    };
+
+    /*!
+         \brief Проверка выравнивания указателя под тип T
+     */
+    template <typename T>
+    bool isAligned(const void *ptr)
+    {
+        return reinterpret_cast<uintptr_t>(ptr) % alignof(T) == 0;
+    }
+
+    /*!
+         \brief Компактный набор битов, по одному на элемент колонки
+     */
+    class Bitmap
+    {
+        std::vector<uint64_t> _words;
+        size_t _size = 0;
+
+    public:
+        static const size_t WORD_BITS = 64;
+
+        Bitmap() = default;
+        explicit Bitmap(size_t size_, bool value = false) { assign(size_, value); }
+
+        /*!
+             \brief Установка размера и значения всех битов
+         */
+        void assign(size_t size_, bool value)
+        {
+            _size = size_;
+            _words.assign((size_ + WORD_BITS - 1) / WORD_BITS, value ? ~uint64_t(0) : 0);
+            trim();
+        }
+        size_t size() const { return _size; }
+        bool test(size_t index) const { return (_words[index / WORD_BITS] >> (index % WORD_BITS)) & 1; }
+        void set(size_t index, bool value = true)
+        {
+            const uint64_t bit = uint64_t(1) << (index % WORD_BITS);
+            if (value)
+                _words[index / WORD_BITS] |= bit;
+            else
+                _words[index / WORD_BITS] &= ~bit;
+        }
+        /*!
+             \brief Установка count младших битов bits начиная с index.
+                    Биты не должны пересекать границу слова, а сами позиции должны быть сброшены
+         */
+        void setBits(size_t index, uint64_t bits)
+        {
+            _words[index / WORD_BITS] |= bits << (index % WORD_BITS);
+        }
+        size_t count() const
+        {
+            size_t res = 0;
+            for (uint64_t word : _words)
+                res += __builtin_popcountll(word);
+            return res;
+        }
+        /*!
+             \brief Инвертирование всех битов
+         */
+        void flip()
+        {
+            for (uint64_t &word : _words)
+                word = ~word;
+            trim();
+        }
+        Bitmap &operator|=(const Bitmap &other)
+        {
+            for (size_t i = 0; i < std::min(_words.size(), other._words.size()); ++i)
+                _words[i] |= other._words[i];
+            return *this;
+        }
+        Bitmap &operator&=(const Bitmap &other)
+        {
+            for (size_t i = 0; i < _words.size(); ++i)
+                _words[i] &= i < other._words.size() ? other._words[i] : 0;
+            return *this;
+        }
+        Span<const uint64_t> words() const { return Span<const uint64_t>(_words.data(), _words.size()); }
+        /*!
+             \brief Вызов onBit(index) для каждого установленного бита по возрастанию, пустые слова пропускаются
+         */
+        template <typename OnBit>
+        void forEach(OnBit &&onBit) const
+        {
+            for (size_t i = 0; i < _words.size(); ++i)
+                for (uint64_t word = _words[i]; word; word &= word - 1)
+                    onBit(i * WORD_BITS + __builtin_ctzll(word));
+        }
+
+    private:
+        void trim()
+        {
+            if (_size % WORD_BITS)
+                _words.back() &= (uint64_t(1) << (_size % WORD_BITS)) - 1;
+        }
+    };
+
+    /*!
+         \brief Прямоугольник со сторонами, параллельными осям
+     */
+    struct Rect
+    {
+        double minX = 0;
+        double minY = 0;
+        double maxX = 0;
+        double maxY = 0;
+
+        double width() const { return maxX - minX; }
+        double height() const { return maxY - minY; }
+        bool intersects(const Rect &other) const
+        {
+            return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+        }
+        /*!
+             \brief Расширение до охвата other
+         */
+        void unite(const Rect &other)
+        {
+            minX = std::min(minX, other.minX);
+            minY = std::min(minY, other.minY);
+            maxX = std::max(maxX, other.maxX);
+            maxY = std::max(maxY, other.maxY);
+        }
+    };
+
+    /*!
+         \brief Монотонный распределитель памяти: выделение - сдвиг указателя в текущем куске,
+                освобождение - только всего сразу через reset(). Куски при этом сохраняются,
+                так что после первого прогона выделения не обращаются к malloc
+     */
+    class Arena
+    {
+        struct Chunk
+        {
+            std::unique_ptr<std::max_align_t[]> data;
+            size_t size;
+
+            explicit Chunk(size_t size_)
+            : data(new std::max_align_t[(size_ + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]),
+              size(size_)
+            {
+            }
+            uint8_t *bytes() const { return reinterpret_cast<uint8_t*>(data.get()); }
+        };
+        std::vector<Chunk> chunks;
+        size_t chunkSize;
+        size_t current = 0;     ///< кусок, из которого идет выделение
+        size_t offset = 0;      ///< занято байт в текущем куске
+
+    public:
+        static const size_t DEFAULT_CHUNK_SIZE = 64 << 10;
+
+        explicit Arena(size_t chunkSize_ = DEFAULT_CHUNK_SIZE)
+        : chunkSize(std::max<size_t>(chunkSize_, 1))
+        {
+        }
+        Arena(const Arena&) = delete;
+        Arena &operator=(const Arena&) = delete;
+
+        /*!
+             \param alignment - степень двойки, не больше alignof(std::max_align_t)
+         */
+        void *allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            for (; current < chunks.size(); ++current, offset = 0)
+            {
+                const size_t begin = (offset + alignment - 1) & ~(alignment - 1);
+                if (begin <= chunks[current].size && size <= chunks[current].size - begin)
+                {
+                    offset = begin + size;
+                    return chunks[current].bytes() + begin;
+                }
+            }
+            chunks.emplace_back(std::max(chunkSize, size));
+            offset = size;
+            return chunks.back().bytes();
+        }
+        /*!
+             \brief Память под count объектов T без вызова конструкторов
+         */
+        template <typename T>
+        T *allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "Arena never calls destructors");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "Over-aligned types are not supported");
+            return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        }
+        /*!
+             \brief Освобождение всех выделений. Память кусков остается за ареной для повторного использования
+         */
+        void reset()
+        {
+            current = 0;
+            offset = 0;
+        }
+        /*!
+             \brief Суммарный размер кусков
+         */
+        size_t capacity() const
+        {
+            size_t res = 0;
+            for (const Chunk &chunk : chunks)
+                res += chunk.size;
+            return res;
+        }
+    };
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "Feature.h"
+#include "Metrics.h"
+#include "Simd.h"
+#include "Utils.h"
+
+namespace Validation
+{
+    /*!
+         \brief Векторные ядра. Параметр допустим, если |value| <= limit: сравнение с NaN ложно,
+                а бесконечность больше любого конечного limit, так что одно сравнение
+                проверяет и конечность, и диапазон. Возвращают индекс первого необработанного элемента
+     */
+    namespace Kernels
+    {
+#if defined(PROSOFT_SIMD_AVX2)
+        inline __m256d inRange4(__m256d value, __m256d limit)
+        {
+            const __m256d abs = _mm256_andnot_pd(_mm256_set1_pd(-0.0), value);
+            return _mm256_cmp_pd(abs, limit, _CMP_LE_OQ);
+        }
+        inline size_t circles(const FeatureBatch::Circles &circles, double limit, Utils::Bitmap &valid)
+        {
+            const __m256d vlimit = _mm256_set1_pd(limit);
+            const __m256d zero = _mm256_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= circles.size(); i += 4)
+            {
+                const __m256d x = _mm256_loadu_pd(circles.centerX.data() + i);
+                const __m256d y = _mm256_loadu_pd(circles.centerY.data() + i);
+                const __m256d r = _mm256_loadu_pd(circles.radius.data() + i);
+                const __m256d ok = _mm256_and_pd(_mm256_and_pd(inRange4(x, vlimit), inRange4(y, vlimit)),
+                                                 _mm256_and_pd(_mm256_cmp_pd(r, zero, _CMP_GE_OQ),
+                                                               _mm256_cmp_pd(r, vlimit, _CMP_LE_OQ)));
+                valid.setBits(i, static_cast<uint64_t>(_mm256_movemask_pd(ok)));
+            }
+            return i;
+        }
+        /*!
+             \brief Параметр k многоугольника i: points[(first + i) * countParams + k], по 4 многоугольника
+         */
+        inline size_t poligons(const FeatureBatch::Poligons &group, double limit, Utils::Bitmap &valid)
+        {
+            const __m256d vlimit = _mm256_set1_pd(limit);
+            const long long stride = static_cast<long long>(group.countParams);
+            const __m256i index = _mm256_set_epi64x(3 * stride, 2 * stride, stride, 0);
+            size_t i = 0;
+            for (; i + 4 <= group.size(); i += 4)
+            {
+                const double *base = group.points.data() + i * group.countParams;
+                __m256d ok = inRange4(_mm256_i64gather_pd(base, index, 8), vlimit);
+                for (size_t k = 1; k < group.countParams; ++k)
+                    ok = _mm256_and_pd(ok, inRange4(_mm256_i64gather_pd(base + k, index, 8), vlimit));
+                valid.setBits(i, static_cast<uint64_t>(_mm256_movemask_pd(ok)));
+            }
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_SSE2)
+        inline __m128d inRange2(__m128d value, __m128d limit)
+        {
+            const __m128d abs = _mm_andnot_pd(_mm_set1_pd(-0.0), value);
+            return _mm_cmple_pd(abs, limit);
+        }
+        inline size_t circles(const FeatureBatch::Circles &circles, double limit, Utils::Bitmap &valid)
+        {
+            const __m128d vlimit = _mm_set1_pd(limit);
+            const __m128d zero = _mm_setzero_pd();
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const __m128d x = _mm_loadu_pd(circles.centerX.data() + i);
+                const __m128d y = _mm_loadu_pd(circles.centerY.data() + i);
+                const __m128d r = _mm_loadu_pd(circles.radius.data() + i);
+                const __m128d ok = _mm_and_pd(_mm_and_pd(inRange2(x, vlimit), inRange2(y, vlimit)),
+                                              _mm_and_pd(_mm_cmpge_pd(r, zero), _mm_cmple_pd(r, vlimit)));
+                valid.setBits(i, static_cast<uint64_t>(_mm_movemask_pd(ok)));
+            }
+            return i;
+        }
+        inline size_t poligons(const FeatureBatch::Poligons &group, double limit, Utils::Bitmap &valid)
+        {
+            const __m128d vlimit = _mm_set1_pd(limit);
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                // параметры групп по 2 идут парами (x, y), так что многоугольник проверяется целыми регистрами
+                const double *p0 = group.points.data() + i * group.countParams;
+                const double *p1 = p0 + group.countParams;
+                __m128d ok0 = inRange2(_mm_loadu_pd(p0), vlimit);
+                __m128d ok1 = inRange2(_mm_loadu_pd(p1), vlimit);
+                for (size_t k = 2; k < group.countParams; k += 2)
+                {
+                    ok0 = _mm_and_pd(ok0, inRange2(_mm_loadu_pd(p0 + k), vlimit));
+                    ok1 = _mm_and_pd(ok1, inRange2(_mm_loadu_pd(p1 + k), vlimit));
+                }
+                valid.setBits(i, (_mm_movemask_pd(ok0) == 3 ? 1u : 0u) | (_mm_movemask_pd(ok1) == 3 ? 2u : 0u));
+            }
+            return i;
+        }
+#elif defined(PROSOFT_SIMD_NEON)
+        inline uint64_t mask2(uint64x2_t ok)
+        {
+            return (vgetq_lane_u64(ok, 0) & 1) | ((vgetq_lane_u64(ok, 1) & 1) << 1);
+        }
+        inline size_t circles(const FeatureBatch::Circles &circles, double limit, Utils::Bitmap &valid)
+        {
+            const float64x2_t vlimit = vdupq_n_f64(limit);
+            size_t i = 0;
+            for (; i + 2 <= circles.size(); i += 2)
+            {
+                const float64x2_t x = vld1q_f64(circles.centerX.data() + i);
+                const float64x2_t y = vld1q_f64(circles.centerY.data() + i);
+                const float64x2_t r = vld1q_f64(circles.radius.data() + i);
+                const uint64x2_t ok = vandq_u64(vandq_u64(vcleq_f64(vabsq_f64(x), vlimit), vcleq_f64(vabsq_f64(y), vlimit)),
+                                                vandq_u64(vcgeq_f64(r, vdupq_n_f64(0)), vcleq_f64(r, vlimit)));
+                valid.setBits(i, mask2(ok));
+            }
+            return i;
+        }
+        inline size_t poligons(const FeatureBatch::Poligons &group, double limit, Utils::Bitmap &valid)
+        {
+            const float64x2_t vlimit = vdupq_n_f64(limit);
+            size_t i = 0;
+            for (; i + 2 <= group.size(); i += 2)
+            {
+                // параметры групп по 2 идут парами (x, y), так что многоугольник проверяется целыми регистрами
+                const double *p0 = group.points.data() + i * group.countParams;
+                const double *p1 = p0 + group.countParams;
+                uint64x2_t ok0 = vcleq_f64(vabsq_f64(vld1q_f64(p0)), vlimit);
+                uint64x2_t ok1 = vcleq_f64(vabsq_f64(vld1q_f64(p1)), vlimit);
+                for (size_t k = 2; k < group.countParams; k += 2)
+                {
+                    ok0 = vandq_u64(ok0, vcleq_f64(vabsq_f64(vld1q_f64(p0 + k)), vlimit));
+                    ok1 = vandq_u64(ok1, vcleq_f64(vabsq_f64(vld1q_f64(p1 + k)), vlimit));
+                }
+                valid.setBits(i, ((vgetq_lane_u64(ok0, 0) & vgetq_lane_u64(ok0, 1)) & 1)
+                                 | (((vgetq_lane_u64(ok1, 0) & vgetq_lane_u64(ok1, 1)) & 1) << 1));
+            }
+            return i;
+        }
+#else
+        inline size_t circles(const FeatureBatch::Circles &, double, Utils::Bitmap &) { return 0; }
+        inline size_t poligons(const FeatureBatch::Poligons &, double, Utils::Bitmap &) { return 0; }
+#endif
+    }
+
+    /*!
+         \brief Проверка декодированных фигур пакета целыми колонками.
+                Фигура отбрасывается, если хотя бы один параметр NaN, бесконечен или по модулю
+                больше limit, а также если радиус круга или длина фигуры others отрицательны.
+                Длины фигур others отличаются от координат по Figure::Figure::lengthParams()
+     */
+    class Validator
+    {
+        double _limit;
+
+        bool inRange(double value) const { return std::fabs(value) <= _limit; }
+
+    public:
+        /*!
+             \param limit - наибольшее допустимое значение параметра по модулю
+         */
+        explicit Validator(double limit = std::numeric_limits<double>::max())
+            : _limit(limit)
+        {
+        }
+        double limit() const { return _limit; }
+
+        /*!
+             \brief Отметка допустимых фигур пакета
+             \return количество недопустимых фигур
+         */
+        size_t select(const FeatureBatch &batch, FeatureBatch::Selection &valid) const
+        {
+            const FeatureBatch::Circles &circles = batch.circles;
+            valid.circles.assign(circles.size(), false);
+            for (size_t i = Kernels::circles(circles, _limit, valid.circles); i < circles.size(); ++i)
+            {
+                const double r = circles.radius[i];
+                valid.circles.set(i, inRange(circles.centerX[i]) && inRange(circles.centerY[i]) && r >= 0 && r <= _limit);
+            }
+
+            select(batch.triangles, valid.triangles);
+            select(batch.squares, valid.squares);
+            valid.others.resize(batch.others.size());
+            for (size_t i = 0; i < batch.others.size(); ++i)
+                select(batch.others[i], valid.others[i]);
+            return batch.size() - valid.count();
+        }
+        /*!
+             \brief Удаление из пакета недопустимых фигур. Пакет без ошибок не перестраивается
+             \return количество удаленных фигур
+         */
+        size_t validate(FeatureBatch &batch) const
+        {
+            FeatureBatch::Selection valid;
+            const size_t countRejected = select(batch, valid);
+            if (countRejected)
+            {
+                batch.filter(valid);
+                PROSOFT_COUNT(eRecordsRejected, countRejected);
+            }
+            return countRejected;
+        }
+
+    private:
+        void select(const FeatureBatch::Poligons &group, Utils::Bitmap &valid) const
+        {
+            valid.assign(group.size(), false);
+            for (size_t i = Kernels::poligons(group, _limit, valid); i < group.size(); ++i)
+            {
+                bool ok = true;
+                for (double value : group.poligon(i))
+                    ok &= inRange(value);
+                valid.set(i, ok);
+            }
+        }
+        void select(const FeatureBatch::Group &group, Utils::Bitmap &valid) const
+        {
+            const uint32_t lengthParams = group.figure->lengthParams();
+            valid.assign(group.size(), false);
+            for (size_t i = 0; i < group.size(); ++i)
+            {
+                const Utils::Span<const double> params = group.record(i);
+                bool ok = true;
+                for (size_t k = 0; k < params.size(); ++k)
+                {
+                    const bool isLength = k < 32 && (lengthParams & (1u << k));
+                    ok &= isLength ? params[k] >= 0 && params[k] <= _limit : inRange(params[k]);
+                }
+                valid.set(i, ok);
+            }
+        }
+    };
+}
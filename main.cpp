@@ -1,329 +1,91 @@
-#include <iostream>
-#include <vector>
-#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
-#include <functional>
-#include <iterator>
-
-namespace Drawer
-{
-    /*!
-         \brief Интерфейс к объекту с базовыми методами отрисовки
-     */
-    class IDrawer
-    {
-    public:
-        virtual ~IDrawer() = default;
-        virtual void drawCircle(double centerX, double centerY, double radius) const = 0;
-        virtual void drawPoligon(const std::vector<double> &points) const = 0;
-    };
-
-    /*!
-         \brief Объект-рисовальщик
-     */
-    class Drawer : public IDrawer
-    {
-    public:
-        void drawCircle(double /*centerX*/, double /*centerY*/, double /*radius*/) const
-        {
-           // ...
-        }
-        void drawPoligon(const std::vector<double> &/*points*/) const
-        {
-           // ...
-        }
-    };
-}
-
-namespace Figure
-{
-    /*!
-         \brief Типы фигур
-     */
-    enum Type
-    {
-        eCircle,
-        eTriangle,
-        eSquare
-    };
-
-    /*!
-         \brief Базовый класс фигуры
-     */
-    class Figure
-    {
-        Type _type;
-        size_t _countParams;
-
-    public:
-        Figure(Type type_, size_t countParams_)
-        : _type(type_),
-          _countParams(countParams_)
-        {
-        }
-        virtual ~Figure() = default;
-        Type type() const { return _type; };
-        size_t countParams() { return _countParams; }
-
-        virtual void draw(const Drawer::IDrawer &drawer, const std::vector<double> &params) const = 0;
-    };
-
-    /*!
-         \brief Реализация фигуры круг
-     */
-    class Circle : public Figure
-    {
-        static const size_t COUNT_PARAMS = 3;
-    public:
-        Circle() : Figure(TYPE, COUNT_PARAMS) {}
-        virtual ~Circle() = default;
-        void draw(const Drawer::IDrawer &drawer, const std::vector<double> &params) const override
-        {
-            if (params.size() >= COUNT_PARAMS)
-                drawer.drawCircle(params[0], params[1], params[2]);
-        }
-        static const Type TYPE = eCircle;
-    };
-
-    /*!
-         \brief Реализация фигуры треугольник
-     */
-    class Triangle : public Figure
-    {
-        static const size_t COUNT_PARAMS = 6;
-    public:
-        Triangle() : Figure(TYPE, COUNT_PARAMS) {}
-        virtual ~Triangle() = default;
-        void draw(const Drawer::IDrawer &drawer, const std::vector<double> &params) const override
-        {
-            if (params.size() >= COUNT_PARAMS)
-                drawer.drawPoligon(params);
-        }
-        static const Type TYPE = eTriangle;
-    };
-
-    /*!
-         \brief Реализация фигуры квадрат
-     */
-    class Square : public Figure
-    {
-        static const size_t COUNT_PARAMS = 8;
-    public:
-        Square() : Figure(TYPE, COUNT_PARAMS) {}
-        virtual ~Square() = default;
-        void draw(const Drawer::IDrawer &drawer, const std::vector<double> &params) const override
-        {
-            if (params.size() >= COUNT_PARAMS)
-                drawer.drawPoligon(params);
-        }
-        static const Type TYPE = eSquare;
-    };
-
-    /*!
-         \brief Фабрика для генерации объектов фигур
-     */
-    class Factory
-    {
-        std::unordered_map<Type, std::function<Figure*()>> figureFactory;
-
-        template <typename FigureImpl>
-        void registerFigure(bool &res)
-        {
-            const Type type = FigureImpl::TYPE;
-            auto it = figureFactory.find(type);
-            if (it != figureFactory.end())
-            {
-                res = false;
-                return;
-            }
-            figureFactory.emplace(type, []() -> Figure* { return new FigureImpl(); });
-        }
-    public:
-        virtual ~Factory() = default;
-        template <typename... Args>
-        bool registerFigure()
-        {
-            bool res = true;
-            int dummy[] = { 0, (registerFigure<Args>(res), 0)... };
-            (void)dummy;
-            return res;
-        }
-        Figure* createFigure(Type type) const
-        {
-            auto it = figureFactory.find(type);
-            if (it == figureFactory.end())
-            {
-                return nullptr;
-            }
-            const auto &creator = it->second;
-            return creator();
-        }
-    };
-}
+#include <string>
+#include <vector>
 
-namespace Reader
-{
-    /*!
-         \brief Интерфейс к объекту читателю
-     */
-    class IReader
-    {
-    public:
-        virtual ~IReader() = default;
-        virtual bool read(void *dst, size_t size, size_t count = 1) const = 0;
-    };
-    /*!
-         \brief Чтение данных из файла
-     */
-    class File : public IReader
-    {
-        std::unique_ptr<FILE, std::function<void(FILE*)>> file;
-    public:
-        explicit File(const std::string &filename)
-            : file(::fopen(filename.c_str(), "rb"), [](FILE* f) { ::fclose(f); })
-        {
-        }
-        bool read(void *dst, size_t size, size_t count = 1) const
-        {
-            if (!dst || !file)
-                return false;
+#include "Drawer.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Metrics.h"
+#include "Pipeline.h"
+#include "Reader.h"
+#include "Shapes.h"
+#include "Sharded.h"
+#include "Testing.h"
 
-            return ::fread(dst, size, count, file.get()) == count;
-        }
-    };
-}
+#define TestMode 0
 
 /*!
-     \brief Класс, реализующий чтение данных, создание объекта фигуры и отрисовку
+     \brief ProSoft [файл или шаблон glob ...] - по умолчанию features.dat.
+            Несколько файлов читаются параллельно как один поток записей
  */
-class Feature
+int main(int argc, char **argv)
 {
-    const Figure::Factory &figureFactory;
-    std::unordered_map<Figure::Type, std::shared_ptr<Figure::Figure>> figures;
-
-    Figure::Figure *currentFigure = nullptr;
-    std::vector<double> currentParams;
+    Figure::Factory figureFactory;
+    Figure::Figures::registerFigures(figureFactory);
+    Shapes::registerShapes(figureFactory);
+    Format::Format format;
 
-public:
-    Feature(const Figure::Factory &figureFactory)
-        : figureFactory(figureFactory)
+#if not TestMode
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
     {
+#ifdef PROSOFT_HAS_GLOB
+        const std::vector<std::string> found = Sharded::glob(argv[i]);
+        files.insert(files.end(), found.begin(), found.end());
+#else
+        files.push_back(argv[i]);
+#endif
     }
-    bool read(const Reader::IReader &reader)
-    {
-        Figure::Type type;
-        if (!reader.read(&type, sizeof(type)))
-            return false;
-
-        auto it = figures.find(type);
-        if (it == figures.end())
-        {
-            Figure::Figure *figure = figureFactory.createFigure(type);
-            if (!figure)
-                return false;
-            it = figures.emplace(type, std::shared_ptr<Figure::Figure>(figure)).first;
-        }
-
-        Figure::Figure *figure = it->second.get();
-
-        using paramType = decltype(currentParams)::value_type;
-        std::vector<paramType> params(figure->countParams());
-        if (!reader.read(params.data(), sizeof(paramType), figure->countParams()))
-            return false;
+    if (argc > 1 && files.empty())
+        return 1;
 
-        currentFigure = figure;
-        currentParams = params;
-        return true;
-    }
-    void draw(const Drawer::IDrawer &drawer)
-    {
-        if (currentFigure)
-            currentFigure->draw(drawer, currentParams);
-    }
-    bool isValid()
+    std::unique_ptr<Reader::IReader> reader;
+    if (files.size() > 1)
     {
-        return !!currentFigure;
+        // PROSOFT_SHARDS=unordered - шарды в порядке загрузки, а не списка
+        const char *order = std::getenv("PROSOFT_SHARDS");
+        Sharded::Reader *shards = new Sharded::Reader(files, order && std::strcmp(order, "unordered") == 0 ? Sharded::eUnordered : Sharded::eOrdered);
+        reader.reset(shards);
+        format = shards->format();
     }
-};
-
-namespace Testing
-{
-    /*!
-         \brief Тестовый mock объект для чтения данных
-     */
-    class ReaderMock : public Reader::IReader
-    {
-    public:
-        bool read(void *dst, size_t /*size*/, size_t count = 1) const override
-        {
-            if (count == 1) // reading of type
-            {
-                const Figure::Type value = Figure::eCircle;
-                memcpy(dst, &value, sizeof(value));
-                std::cout << "ReaderMock::read(): type: eCircle" << std::endl;
-                return true;
-            }
-
-            // reading of params
-            std::cout << "ReaderMock::read(): params: { ";
-            const double value = 2.1;
-            while(count--)
-            {
-                std::cout << value << " ";
-                memcpy(dst, &value, sizeof(value));
-                dst = reinterpret_cast<uint8_t*>(dst) + sizeof(value);
-            }
-            std::cout << "} " << std::endl;
-            return true;
-        }
-    };
-
-    /*!
-         \brief Тестовый mock объект для отрисовки
-     */
-    class DrawerMock : public Drawer::IDrawer
-    {
-    public:
-        void drawCircle(double centerX, double centerY, double radius)  const override
-        {
-            std::cout << "DrawerMock::drawCircle():"
-                      << " centerX = " << centerX
-                      << " centerY = " << centerY
-                      << " radius = "  << radius
-                      << std::endl;
-        }
-
-        void drawPoligon(const std::vector<double> &points)  const override
-        {
-            std::cout << "DrawerMock::drawPoligon(): params: { ";
-            std::copy(points.cbegin(), points.cend(), std::ostream_iterator<double>(std::cout, " "));
-            std::cout << "} " << std::endl;
-        }
-    };
-}
-
-#define TestMode 0
-
-int main()
-{
-    Figure::Factory figureFactory;
-    figureFactory.registerFigure<Figure::Circle, Figure::Triangle, Figure::Square>();
-
-#if not TestMode
-    Reader::File reader("features.dat");
+    const std::string filename = files.empty() ? "features.dat" : files.front();
+#ifdef PROSOFT_HAS_TAIL
+    // PROSOFT_FOLLOW_MS=<мс> - чтение дописываемого файла до паузы в записи такой длины
+    if (const char *follow = std::getenv("PROSOFT_FOLLOW_MS"); follow && !reader)
+        reader.reset(new Reader::Tail(filename, 0, std::chrono::milliseconds(std::max(std::atoll(follow), 1ll))));
+#endif
     Drawer::Drawer drawer;
+    // PROSOFT_IO=async|direct - чтение очередью асинхронных запросов, direct - в обход страничного кэша
+    if (const char *io = std::getenv("PROSOFT_IO"); io && !reader)
+        reader = Reader::openAsync(filename, std::strcmp(io, "direct") == 0);
+    if (!reader)
+        reader = Reader::open(filename);
+    if (files.size() <= 1 && !Format::detect(*reader, format))
+        return 1;
 #else
-    Testing::ReaderMock reader;
+    const std::unique_ptr<Reader::IReader> reader(new Testing::ReaderMock);
     Testing::DrawerMock drawer;
 #endif
 
-    Feature feature(figureFactory);
+    Pipeline::Executor executor(figureFactory);
+    executor.setFormat(format);
+    const Pipeline::Executor::Result result = executor.run(*reader, drawer);
 
-    feature.read(reader);
-    feature.draw(drawer);
+    // PROSOFT_METRICS_FORMAT=json|prometheus - вывод счетчиков в stderr
+    if (const char *metricsFormat = std::getenv("PROSOFT_METRICS_FORMAT"))
+    {
+        if (std::strcmp(metricsFormat, "json") == 0)
+            std::fprintf(stderr, "%s\n", Metrics::toJson(Metrics::snapshot()).c_str());
+        else if (std::strcmp(metricsFormat, "prometheus") == 0)
+            std::fprintf(stderr, "%s", Metrics::toPrometheus(Metrics::snapshot()).c_str());
+    }
 
-    if (!feature.isValid())
+    if (!result.countRecords)
         return 1;
 
     return 0;
@@ -0,0 +1,211 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "Generator.h"
+
+namespace
+{
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -o, --output FILE          output file (default features.dat)\n"
+            "  -s, --size SIZE            target size in bytes, suffixes K, M, G (default 1M)\n"
+            "  -n, --records COUNT        number of records, overrides --size\n"
+            "  -m, --mix C:T:S            relative share of circles, triangles and squares (default 1:1:1)\n"
+            "  -d, --distribution NAME    uniform, normal or clusters (default uniform)\n"
+            "      --clusters COUNT       number of clusters for --distribution clusters (default 16)\n"
+            "      --extent VALUE         side of the square area (default 1e6)\n"
+            "      --min-size VALUE       minimal figure radius (default 1)\n"
+            "      --max-size VALUE       maximal figure radius (default 100)\n"
+            "      --seed VALUE           random seed (default 1)\n"
+            "  -e, --encoding NAME        f64, f32, i32 or i16 parameters after a versioned header,\n"
+            "                             quantized relative to the area center (default: headerless f64)\n"
+            "      --length-prefix        versioned header with a length prefix in every record, so that\n"
+            "                             readers skip records of figure types they do not know\n"
+            "  -c, --compress CODEC       write a block-compressed container: none, lz4, zstd or deflate\n"
+            "      --block-size SIZE      uncompressed size of a container block (default 1M)\n"
+            "      --level VALUE          compression level, 0 - codec default (default 0)\n",
+            program);
+    }
+
+    bool parseSize(const char *text, uint64_t &size)
+    {
+        char *end = nullptr;
+        const double value = std::strtod(text, &end);
+        if (end == text || value < 0)
+            return false;
+
+        uint64_t multiplier = 1;
+        switch (*end)
+        {
+        case 'K': case 'k': multiplier = 1ull << 10; ++end; break;
+        case 'M': case 'm': multiplier = 1ull << 20; ++end; break;
+        case 'G': case 'g': multiplier = 1ull << 30; ++end; break;
+        default: break;
+        }
+        if (*end)
+            return false;
+        size = static_cast<uint64_t>(value * multiplier);
+        return true;
+    }
+
+    bool parseMix(const char *text, std::array<double, Figure::eCountTypes> &mix)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < mix.size(); ++i)
+        {
+            char *end = nullptr;
+            mix[i] = std::strtod(text, &end);
+            if (end == text || mix[i] < 0 || (i + 1 < mix.size() ? *end != ':' : *end != '\0'))
+                return false;
+            sum += mix[i];
+            text = end + 1;
+        }
+        return sum > 0;
+    }
+
+    bool parseCodec(const std::string &name, Compression::Codec &codec)
+    {
+        const char *NAMES[Compression::eCountCodecs] = { "none", "lz4", "zstd", "deflate" };
+        for (uint32_t i = 0; i < Compression::eCountCodecs; ++i)
+        {
+            if (name == NAMES[i])
+            {
+                codec = static_cast<Compression::Codec>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseEncoding(const std::string &name, Format::Encoding &encoding)
+    {
+        const char *NAMES[Format::eCountEncodings] = { "f64", "f32", "i32", "i16" };
+        for (uint32_t i = 0; i < Format::eCountEncodings; ++i)
+        {
+            if (name == NAMES[i])
+            {
+                encoding = static_cast<Format::Encoding>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string output = "features.dat";
+    Generator::Options options;
+    options.size = 1 << 20;
+    bool versioned = false;
+    bool lengthPrefix = false;
+    Format::Encoding encoding = Format::eFloat64;
+    bool compressed = false;
+    Compression::Codec codec = Compression::eNone;
+    uint64_t blockSize = 1 << 20;
+    int level = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = !!value;
+        if (arg == "-h" || arg == "--help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (arg == "--length-prefix")
+        {
+            lengthPrefix = versioned = true;
+            continue;
+        }
+        else if (ok && (arg == "-o" || arg == "--output"))
+            output = value;
+        else if (ok && (arg == "-s" || arg == "--size"))
+            ok = parseSize(value, options.size);
+        else if (ok && (arg == "-n" || arg == "--records"))
+            ok = parseSize(value, options.countRecords);
+        else if (ok && (arg == "-m" || arg == "--mix"))
+            ok = parseMix(value, options.mix);
+        else if (ok && (arg == "-d" || arg == "--distribution"))
+        {
+            const std::string name = value;
+            if (name == "uniform")
+                options.distribution = Generator::eUniform;
+            else if (name == "normal")
+                options.distribution = Generator::eNormal;
+            else if (name == "clusters")
+                options.distribution = Generator::eClusters;
+            else
+                ok = false;
+        }
+        else if (ok && arg == "--clusters")
+            options.countClusters = std::strtoul(value, nullptr, 10);
+        else if (ok && arg == "--extent")
+            options.extent = std::strtod(value, nullptr);
+        else if (ok && arg == "--min-size")
+            options.minSize = std::strtod(value, nullptr);
+        else if (ok && arg == "--max-size")
+            options.maxSize = std::strtod(value, nullptr);
+        else if (ok && arg == "--seed")
+            options.seed = std::strtoull(value, nullptr, 10);
+        else if (ok && (arg == "-e" || arg == "--encoding"))
+            ok = versioned = parseEncoding(value, encoding);
+        else if (ok && (arg == "-c" || arg == "--compress"))
+            ok = compressed = parseCodec(value, codec);
+        else if (ok && arg == "--block-size")
+            ok = parseSize(value, blockSize) && blockSize > 0 && blockSize <= Compression::MAX_BLOCK_SIZE / 2;
+        else if (ok && arg == "--level")
+            level = std::atoi(value);
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            std::fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+            usage(argv[0]);
+            return 2;
+        }
+        ++i;
+    }
+
+    if (compressed && !Compression::isAvailable(codec))
+    {
+        std::fprintf(stderr, "Compression codec is not available in this build\n");
+        return 2;
+    }
+    if (versioned)
+    {
+        // фигуры у края области выходят за нее на свой размер
+        const double margin = options.maxSize;
+        options.format = Format::Format::fit(encoding, { -margin, -margin, options.extent + margin, options.extent + margin });
+        if (lengthPrefix)
+            options.format.flags |= Format::Format::eLengthPrefix;
+    }
+
+    std::unique_ptr<FILE, int(*)(FILE*)> file(std::fopen(output.c_str(), "wb"), std::fclose);
+    if (!file)
+    {
+        std::fprintf(stderr, "Cannot open %s: %s\n", output.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    Generator::Generator generator(options);
+    Compression::Writer writer(file.get(), codec, level);
+    const uint64_t countRecords = compressed ? generator.write(writer, blockSize) : generator.write(file.get());
+    if (!countRecords || std::fflush(file.get()) != 0)
+    {
+        std::fprintf(stderr, "Cannot write %s: %s\n", output.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    std::printf("%s: %llu records\n", output.c_str(), static_cast<unsigned long long>(countRecords));
+    return 0;
+}
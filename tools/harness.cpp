@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Drawer.h"
+#include "Figure.h"
+#include "Format.h"
+#include "Generator.h"
+#include "Metrics.h"
+#include "Pipeline.h"
+#include "Reader.h"
+#include "Scheduler.h"
+
+namespace
+{
+    void usage(const char *program)
+    {
+        std::fprintf(stderr,
+            "Usage: %s [options]\n"
+            "Runs read, decode and draw of generated files and prints one JSON line per size and thread count\n"
+            "  -s, --sizes LIST           file sizes, suffixes K, M, G (default 1M,16M,256M)\n"
+            "  -t, --threads LIST         shared pool threads (default 1,2,4,... up to the number of cores)\n"
+            "  -r, --repeat COUNT         runs per point, the fastest is reported (default 3)\n"
+            "  -e, --encoding NAME        f64, f32, i32 or i16 parameters after a versioned header\n"
+            "                             (default: headerless f64)\n"
+            "      --io NAME              reader: mapped, buffered or async (default mapped)\n"
+            "      --dir DIR              directory for generated files (default .)\n"
+            "      --keep                 keep generated files and reuse existing ones\n"
+            "      --label TEXT           label copied into every line, e.g. a release version\n",
+            program);
+    }
+
+    bool parseSize(const char *text, uint64_t &size)
+    {
+        char *end = nullptr;
+        const double value = std::strtod(text, &end);
+        if (end == text || value <= 0)
+            return false;
+
+        uint64_t multiplier = 1;
+        switch (*end)
+        {
+        case 'K': case 'k': multiplier = 1ull << 10; ++end; break;
+        case 'M': case 'm': multiplier = 1ull << 20; ++end; break;
+        case 'G': case 'g': multiplier = 1ull << 30; ++end; break;
+        default: break;
+        }
+        if (*end)
+            return false;
+        size = static_cast<uint64_t>(value * multiplier);
+        return true;
+    }
+
+    /*!
+         \brief Список через запятую, каждый элемент разбирается parse
+     */
+    template <typename Parse>
+    bool parseList(const char *text, std::vector<uint64_t> &values, Parse &&parse)
+    {
+        values.clear();
+        std::string item;
+        for (const char *it = text;; ++it)
+        {
+            if (*it && *it != ',')
+            {
+                item += *it;
+                continue;
+            }
+            uint64_t value = 0;
+            if (!parse(item.c_str(), value))
+                return false;
+            values.push_back(value);
+            item.clear();
+            if (!*it)
+                return true;
+        }
+    }
+
+    bool parseCount(const char *text, uint64_t &count)
+    {
+        char *end = nullptr;
+        count = std::strtoull(text, &end, 10);
+        return end != text && !*end && count > 0;
+    }
+
+    bool parseEncoding(const std::string &name, Format::Encoding &encoding)
+    {
+        const char *NAMES[Format::eCountEncodings] = { "f64", "f32", "i32", "i16" };
+        for (uint32_t i = 0; i < Format::eCountEncodings; ++i)
+        {
+            if (name == NAMES[i])
+            {
+                encoding = static_cast<Format::Encoding>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*!
+         \brief Отрисовщик-счетчик для пакетной отрисовки задачами пула: проверяется масштабирование
+                самого конвейера, а не стоимость растеризации
+     */
+    class CountingDrawer : public Drawer::IDrawer
+    {
+        mutable std::atomic<uint64_t> countFigures{0};
+
+    public:
+        bool isThreadSafe() const override { return true; }
+        void drawCircle(double, double, double) const override { countFigures.fetch_add(1, std::memory_order_relaxed); }
+        void drawPoligon(Utils::Span<const double>) const override { countFigures.fetch_add(1, std::memory_order_relaxed); }
+        void drawCircles(Utils::Span<const double>, Utils::Span<const double>, Utils::Span<const double> radius) const override
+        {
+            countFigures.fetch_add(radius.size(), std::memory_order_relaxed);
+        }
+        void drawPoligons(Utils::Span<const double>, Utils::Span<const uint32_t> offsets) const override
+        {
+            countFigures.fetch_add(offsets.empty() ? 0 : offsets.size() - 1, std::memory_order_relaxed);
+        }
+    };
+
+    enum Io
+    {
+        eMapped,
+        eBuffered,
+        eAsync
+    };
+
+    struct Options
+    {
+        std::vector<uint64_t> sizes = { 1ull << 20, 16ull << 20, 256ull << 20 };
+        std::vector<uint64_t> threads;
+        uint64_t repeat = 3;
+        bool versioned = false;
+        Format::Encoding encoding = Format::eFloat64;
+        Io io = eMapped;
+        std::string dir = ".";
+        bool keep = false;
+        std::string label;
+    };
+
+    std::unique_ptr<Reader::IReader> open(const std::string &filename, Io io)
+    {
+        switch (io)
+        {
+        case eBuffered:
+            return std::unique_ptr<Reader::IReader>(new Reader::BufferedFile(filename));
+        case eAsync:
+            return Reader::openAsync(filename);
+        default:
+            return Reader::open(filename);
+        }
+    }
+
+    std::string fileName(const Options &options, uint64_t size)
+    {
+        const char *NAMES[Format::eCountEncodings] = { "f64", "f32", "i32", "i16" };
+        return (std::filesystem::path(options.dir)
+                / ("prosoft_harness_" + std::to_string(size) + "_" + (options.versioned ? NAMES[options.encoding] : "raw") + ".dat")).string();
+    }
+
+    bool generate(const Options &options, uint64_t size, const std::string &filename)
+    {
+        Generator::Options generatorOptions;
+        generatorOptions.size = size;
+        generatorOptions.distribution = Generator::eClusters;
+        if (options.versioned)
+        {
+            const double margin = generatorOptions.maxSize;
+            generatorOptions.format = Format::Format::fit(options.encoding, { -margin, -margin,
+                generatorOptions.extent + margin, generatorOptions.extent + margin });
+        }
+        std::unique_ptr<FILE, int(*)(FILE*)> file(std::fopen(filename.c_str(), "wb"), std::fclose);
+        if (!file)
+            return false;
+        Generator::Generator generator(generatorOptions);
+        return generator.write(file.get()) && std::fflush(file.get()) == 0;
+    }
+
+    /*!
+         \brief Замер одной точки в дочернем процессе: пул создается с нужным числом потоков,
+                а пиковая память процесса относится только к этому замеру
+         \return false, если замер не удался
+     */
+    bool measure(const Options &options, const std::string &filename, uint64_t size, uint64_t countThreads)
+    {
+        std::fflush(stdout);
+        const pid_t pid = fork();
+        if (pid < 0)
+            return false;
+        if (pid > 0)
+        {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+                ;
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+
+        setenv("PROSOFT_THREADS", std::to_string(countThreads).c_str(), 1);
+        Figure::Factory figureFactory;
+        Figure::Figures::registerFigures(figureFactory);
+        const CountingDrawer drawer;
+        Pipeline::Executor executor(figureFactory);
+
+        std::vector<double> seconds;
+        Pipeline::Executor::Result best;
+        Metrics::Snapshot bestMetrics;
+        for (uint64_t i = 0; i < options.repeat; ++i)
+        {
+            const std::unique_ptr<Reader::IReader> reader = open(filename, options.io);
+            Format::Format format;
+            if (!Format::detect(*reader, format))
+                _exit(1);
+            executor.setFormat(format);
+
+            const Metrics::Snapshot before = Metrics::snapshot();
+            const auto start = std::chrono::steady_clock::now();
+            const Pipeline::Executor::Result result = executor.run(*reader, drawer);
+            seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            if (!result.ok || !result.countRecords)
+                _exit(1);
+            if (seconds.back() <= *std::min_element(seconds.begin(), seconds.end()))
+            {
+                best = result;
+                bestMetrics = Metrics::snapshot() - before;
+            }
+        }
+
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        const double fastest = *std::min_element(seconds.begin(), seconds.end());
+        std::sort(seconds.begin(), seconds.end());
+        const double bytes = static_cast<double>(std::filesystem::file_size(filename));
+        std::string label;
+        for (char c : options.label)
+            if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20)
+                label += c;
+
+        std::printf("{\"label\":\"%s\",\"size\":%llu,\"file_bytes\":%.0f,\"threads\":%llu,\"runs\":%llu,"
+                    "\"records\":%llu,\"seconds\":%.6f,\"median_seconds\":%.6f,"
+                    "\"records_per_second\":%.1f,\"mb_per_second\":%.3f,\"peak_rss_bytes\":%llu,\"metrics\":%s}\n",
+                    label.c_str(), static_cast<unsigned long long>(size), bytes,
+                    static_cast<unsigned long long>(Scheduler::Pool::shared().size()),
+                    static_cast<unsigned long long>(options.repeat),
+                    static_cast<unsigned long long>(best.countRecords), fastest, seconds[seconds.size() / 2],
+                    best.countRecords / fastest, bytes / (1 << 20) / fastest,
+                    static_cast<unsigned long long>(usage.ru_maxrss) * 1024,    // ru_maxrss в Linux - в килобайтах
+                    Metrics::toJson(bestMetrics).c_str());
+        std::fflush(stdout);
+        _exit(0);
+    }
+}
+
+/*!
+     \brief ProSoft_harness - сквозные замеры конвейера по размерам файлов и числу потоков.
+            Результат - JSON по строке на точку в stdout, чтобы сравнивать кривые масштабирования
+            между версиями. Время стадий берется из Metrics и нулевое при PROSOFT_METRICS=OFF
+ */
+int main(int argc, char **argv)
+{
+    Options options;
+    for (uint64_t count = 1; count <= std::max(std::thread::hardware_concurrency(), 1u); count *= 2)
+        options.threads.push_back(count);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        bool ok = !!value;
+        if (arg == "-h" || arg == "--help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (arg == "--keep")
+        {
+            options.keep = true;
+            continue;
+        }
+        else if (ok && (arg == "-s" || arg == "--sizes"))
+            ok = parseList(value, options.sizes, parseSize);
+        else if (ok && (arg == "-t" || arg == "--threads"))
+            ok = parseList(value, options.threads, parseCount);
+        else if (ok && (arg == "-r" || arg == "--repeat"))
+            ok = parseCount(value, options.repeat);
+        else if (ok && (arg == "-e" || arg == "--encoding"))
+            ok = options.versioned = parseEncoding(value, options.encoding);
+        else if (ok && arg == "--io")
+        {
+            const std::string name = value;
+            if (name == "mapped")
+                options.io = eMapped;
+            else if (name == "buffered")
+                options.io = eBuffered;
+            else if (name == "async")
+                options.io = eAsync;
+            else
+                ok = false;
+        }
+        else if (ok && arg == "--dir")
+            options.dir = value;
+        else if (ok && arg == "--label")
+            options.label = value;
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            std::fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+            usage(argv[0]);
+            return 2;
+        }
+        ++i;
+    }
+
+    int res = 0;
+    for (uint64_t size : options.sizes)
+    {
+        const std::string filename = fileName(options, size);
+        std::error_code error;
+        if (!(options.keep && std::filesystem::is_regular_file(filename, error)))
+        {
+            std::fprintf(stderr, "Generating %s\n", filename.c_str());
+            if (!generate(options, size, filename))
+            {
+                std::fprintf(stderr, "Cannot write %s: %s\n", filename.c_str(), std::strerror(errno));
+                return 1;
+            }
+        }
+        for (uint64_t countThreads : options.threads)
+        {
+            if (!measure(options, filename, size, countThreads))
+            {
+                std::fprintf(stderr, "Run failed: %s, %llu threads\n", filename.c_str(), static_cast<unsigned long long>(countThreads));
+                res = 1;
+            }
+        }
+        if (!options.keep)
+            std::filesystem::remove(filename, error);
+    }
+    return res;
+}